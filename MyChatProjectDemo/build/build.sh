@@ -31,3 +31,8 @@ echo "编译 gateway_server 成功!"
 echo "编译 log_server..."
 g++ -o log_server log_server.cpp -levent -lpthread
 echo "编译 log_server 成功!"
+
+# 编译 log_query.cpp
+echo "编译 log_query..."
+g++ -o log_query log_query.cpp
+echo "编译 log_query 成功!"
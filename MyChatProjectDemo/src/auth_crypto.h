@@ -0,0 +1,394 @@
+#ifndef AUTH_CRYPTO_H
+#define AUTH_CRYPTO_H
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// 认证用的密码学工具（仅头文件，不依赖外部库）：SHA-256、HMAC-SHA256、
+// PBKDF2 和 scrypt，以及密码哈希串和会话令牌。
+//
+// 密码只以 scrypt 加盐哈希保存，每次校验要花几十毫秒和十几 MiB 内存，只在登录时
+// 做一次。登录成功发一个带 HMAC 签名的令牌，之后的 check_token 只算一次 HMAC
+// （密钥的内外两个状态预先算好，只剩几次压缩），不查表也不再哈希密码。
+namespace crypto {
+
+// SHA-256 的增量计算
+class Sha256 {
+public:
+    Sha256() {
+        static const uint32_t init[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                         0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+        memcpy(state, init, sizeof(state));
+    }
+
+    void update(const void *data, size_t len) {
+        const uint8_t *p = static_cast<const uint8_t *>(data);
+        while (len > 0) {
+            size_t used = total % 64;
+            size_t n = std::min(len, 64 - used);
+            memcpy(block + used, p, n);
+            total += n;
+            p += n;
+            len -= n;
+            if (total % 64 == 0) {
+                compress(block);
+            }
+        }
+    }
+
+    void final(uint8_t out[32]) {
+        uint64_t bits = total * 8;
+        uint8_t pad = 0x80;
+        update(&pad, 1);
+        pad = 0;
+        while (total % 64 != 56) {
+            update(&pad, 1);
+        }
+        uint8_t length[8];
+        for (int i = 0; i < 8; i++) {
+            length[i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+        }
+        update(length, 8);
+        for (int i = 0; i < 8; i++) {
+            out[4 * i] = static_cast<uint8_t>(state[i] >> 24);
+            out[4 * i + 1] = static_cast<uint8_t>(state[i] >> 16);
+            out[4 * i + 2] = static_cast<uint8_t>(state[i] >> 8);
+            out[4 * i + 3] = static_cast<uint8_t>(state[i]);
+        }
+    }
+
+private:
+    uint32_t state[8];
+    uint8_t block[64];
+    uint64_t total = 0;
+
+    static uint32_t rotr(uint32_t x, int n) {
+        return (x >> n) | (x << (32 - n));
+    }
+
+    void compress(const uint8_t *data) {
+        static const uint32_t k[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            w[i] = uint32_t(data[4 * i]) << 24 | uint32_t(data[4 * i + 1]) << 16 |
+                   uint32_t(data[4 * i + 2]) << 8 | data[4 * i + 3];
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+};
+
+// HMAC-SHA256。构造时把密钥和 ipad/opad 的两个 SHA-256 状态算好，
+// 之后每次 mac() 都从这两个状态复制开始，不再处理密钥
+class Hmac {
+public:
+    Hmac(const void *key, size_t len) {
+        uint8_t block[64] = {0};
+        if (len > 64) {
+            Sha256 hash;
+            hash.update(key, len);
+            hash.final(block);
+        } else {
+            memcpy(block, key, len);
+        }
+        uint8_t pad[64];
+        for (int i = 0; i < 64; i++) {
+            pad[i] = block[i] ^ 0x36;
+        }
+        inner.update(pad, 64);
+        for (int i = 0; i < 64; i++) {
+            pad[i] = block[i] ^ 0x5c;
+        }
+        outer.update(pad, 64);
+    }
+
+    // 计算 data1 || data2 的 MAC
+    void mac(const void *data, size_t len, uint8_t out[32], const void *data2 = nullptr, size_t len2 = 0) const {
+        Sha256 hash = inner;
+        hash.update(data, len);
+        if (len2 > 0) {
+            hash.update(data2, len2);
+        }
+        uint8_t digest[32];
+        hash.final(digest);
+        hash = outer;
+        hash.update(digest, 32);
+        hash.final(out);
+    }
+
+private:
+    Sha256 inner;
+    Sha256 outer;
+};
+
+// PBKDF2-HMAC-SHA256
+inline void pbkdf2_sha256(const void *password, size_t password_len, const uint8_t *salt, size_t salt_len,
+                          uint32_t iterations, uint8_t *out, size_t out_len) {
+    Hmac hmac(password, password_len);
+    for (uint32_t block = 1; out_len > 0; block++) {
+        uint8_t index[4] = {uint8_t(block >> 24), uint8_t(block >> 16), uint8_t(block >> 8), uint8_t(block)};
+        uint8_t u[32], t[32];
+        hmac.mac(salt, salt_len, u, index, 4);
+        memcpy(t, u, 32);
+        for (uint32_t i = 1; i < iterations; i++) {
+            hmac.mac(u, 32, u);
+            for (int j = 0; j < 32; j++) {
+                t[j] ^= u[j];
+            }
+        }
+        size_t n = std::min<size_t>(out_len, 32);
+        memcpy(out, t, n);
+        out += n;
+        out_len -= n;
+    }
+}
+
+// scrypt 内部的 Salsa20/8 核心
+inline void salsa20_8(uint32_t b[16]) {
+    uint32_t x[16];
+    memcpy(x, b, sizeof(x));
+#define ROTL32(a, n) (((a) << (n)) | ((a) >> (32 - (n))))
+    for (int i = 0; i < 8; i += 2) {
+        x[4] ^= ROTL32(x[0] + x[12], 7);   x[8] ^= ROTL32(x[4] + x[0], 9);
+        x[12] ^= ROTL32(x[8] + x[4], 13);  x[0] ^= ROTL32(x[12] + x[8], 18);
+        x[9] ^= ROTL32(x[5] + x[1], 7);    x[13] ^= ROTL32(x[9] + x[5], 9);
+        x[1] ^= ROTL32(x[13] + x[9], 13);  x[5] ^= ROTL32(x[1] + x[13], 18);
+        x[14] ^= ROTL32(x[10] + x[6], 7);  x[2] ^= ROTL32(x[14] + x[10], 9);
+        x[6] ^= ROTL32(x[2] + x[14], 13);  x[10] ^= ROTL32(x[6] + x[2], 18);
+        x[3] ^= ROTL32(x[15] + x[11], 7);  x[7] ^= ROTL32(x[3] + x[15], 9);
+        x[11] ^= ROTL32(x[7] + x[3], 13);  x[15] ^= ROTL32(x[11] + x[7], 18);
+        x[1] ^= ROTL32(x[0] + x[3], 7);    x[2] ^= ROTL32(x[1] + x[0], 9);
+        x[3] ^= ROTL32(x[2] + x[1], 13);   x[0] ^= ROTL32(x[3] + x[2], 18);
+        x[6] ^= ROTL32(x[5] + x[4], 7);    x[7] ^= ROTL32(x[6] + x[5], 9);
+        x[4] ^= ROTL32(x[7] + x[6], 13);   x[5] ^= ROTL32(x[4] + x[7], 18);
+        x[11] ^= ROTL32(x[10] + x[9], 7);  x[8] ^= ROTL32(x[11] + x[10], 9);
+        x[9] ^= ROTL32(x[8] + x[11], 13);  x[10] ^= ROTL32(x[9] + x[8], 18);
+        x[12] ^= ROTL32(x[15] + x[14], 7); x[13] ^= ROTL32(x[12] + x[15], 9);
+        x[14] ^= ROTL32(x[13] + x[12], 13); x[15] ^= ROTL32(x[14] + x[13], 18);
+    }
+#undef ROTL32
+    for (int i = 0; i < 16; i++) {
+        b[i] += x[i];
+    }
+}
+
+// scrypt 的 BlockMix：b 是 2r 个 64 字节块，结果写回 b，y 是同样大小的临时区
+inline void scrypt_blockmix(uint32_t *b, uint32_t *y, uint32_t r) {
+    uint32_t x[16];
+    memcpy(x, b + (2 * r - 1) * 16, 64);
+    for (uint32_t i = 0; i < 2 * r; i++) {
+        for (int j = 0; j < 16; j++) {
+            x[j] ^= b[i * 16 + j];
+        }
+        salsa20_8(x);
+        // 偶数块放前半，奇数块放后半
+        memcpy(y + ((i & 1) * r + i / 2) * 16, x, 64);
+    }
+    memcpy(b, y, 128 * r);
+}
+
+// scrypt(password, salt, N = 2^log_n, r, p)，结果 out_len 字节
+inline void scrypt(const std::string &password, const uint8_t *salt, size_t salt_len, int log_n, uint32_t r,
+                   uint32_t p, uint8_t *out, size_t out_len) {
+    uint64_t n = uint64_t(1) << log_n;
+    size_t words = 32 * r; // 一个 128r 字节的块有多少个 32 位字
+    std::vector<uint8_t> bytes(128 * r * p);
+    pbkdf2_sha256(password.data(), password.size(), salt, salt_len, 1, bytes.data(), bytes.size());
+    std::vector<uint32_t> x(words), y(words), v(words * n);
+    for (uint32_t i = 0; i < p; i++) {
+        uint8_t *chunk = bytes.data() + i * 128 * r;
+        for (size_t k = 0; k < words; k++) {
+            x[k] = uint32_t(chunk[4 * k]) | uint32_t(chunk[4 * k + 1]) << 8 |
+                   uint32_t(chunk[4 * k + 2]) << 16 | uint32_t(chunk[4 * k + 3]) << 24;
+        }
+        // ROMix：先顺序填满 N 个块，再按数据决定的顺序随机读回（内存困难的部分）
+        for (uint64_t j = 0; j < n; j++) {
+            memcpy(&v[j * words], x.data(), words * 4);
+            scrypt_blockmix(x.data(), y.data(), r);
+        }
+        for (uint64_t j = 0; j < n; j++) {
+            uint64_t index = x[(2 * r - 1) * 16] & (n - 1);
+            for (size_t k = 0; k < words; k++) {
+                x[k] ^= v[index * words + k];
+            }
+            scrypt_blockmix(x.data(), y.data(), r);
+        }
+        for (size_t k = 0; k < words; k++) {
+            chunk[4 * k] = uint8_t(x[k]);
+            chunk[4 * k + 1] = uint8_t(x[k] >> 8);
+            chunk[4 * k + 2] = uint8_t(x[k] >> 16);
+            chunk[4 * k + 3] = uint8_t(x[k] >> 24);
+        }
+    }
+    pbkdf2_sha256(password.data(), password.size(), bytes.data(), bytes.size(), 1, out, out_len);
+}
+
+// 比较两段字节，耗时与内容无关
+inline bool equal(const uint8_t *a, const uint8_t *b, size_t len) {
+    uint8_t diff = 0;
+    for (size_t i = 0; i < len; i++) {
+        diff |= a[i] ^ b[i];
+    }
+    return diff == 0;
+}
+
+inline std::string to_hex(const uint8_t *data, size_t len) {
+    static const char digits[] = "0123456789abcdef";
+    std::string out;
+    for (size_t i = 0; i < len; i++) {
+        out += digits[data[i] >> 4];
+        out += digits[data[i] & 15];
+    }
+    return out;
+}
+
+// 解析 2 * len 个十六进制字符（小写）
+inline bool from_hex(const char *hex, uint8_t *out, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        int value = 0;
+        for (int k = 0; k < 2; k++) {
+            char c = hex[2 * i + k];
+            int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+            if (digit < 0) {
+                return false;
+            }
+            value = value * 16 + digit;
+        }
+        out[i] = static_cast<uint8_t>(value);
+    }
+    return true;
+}
+
+// 从 /dev/urandom 取随机字节
+inline bool random_bytes(uint8_t *out, size_t len) {
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    bool ok = read(fd, out, len) == static_cast<ssize_t>(len);
+    close(fd);
+    return ok;
+}
+
+// 密码哈希的参数：N = 2^14、r = 8、p = 1，约 16 MiB 内存
+const int SCRYPT_LOG_N = 14;
+const uint32_t SCRYPT_R = 8;
+const uint32_t SCRYPT_P = 1;
+const size_t SALT_SIZE = 16;
+const size_t HASH_SIZE = 32;
+
+// 为密码生成保存用的哈希串：scrypt$<log N>$<r>$<p>$<盐 hex>$<哈希 hex>
+inline std::string hash_password(const std::string &password) {
+    uint8_t salt[SALT_SIZE], hash[HASH_SIZE];
+    if (!random_bytes(salt, sizeof(salt))) {
+        return "";
+    }
+    scrypt(password, salt, sizeof(salt), SCRYPT_LOG_N, SCRYPT_R, SCRYPT_P, hash, sizeof(hash));
+    char params[32];
+    snprintf(params, sizeof(params), "scrypt$%d$%u$%u$", SCRYPT_LOG_N, SCRYPT_R, SCRYPT_P);
+    return params + to_hex(salt, sizeof(salt)) + "$" + to_hex(hash, sizeof(hash));
+}
+
+// 用保存的哈希串校验密码；哈希串格式不对时返回 false
+inline bool verify_password(const std::string &password, const std::string &stored) {
+    int log_n;
+    unsigned r, p;
+    char salt_hex[2 * SALT_SIZE + 1], hash_hex[2 * HASH_SIZE + 1];
+    if (sscanf(stored.c_str(), "scrypt$%d$%u$%u$%32[0-9a-f]$%64[0-9a-f]", &log_n, &r, &p, salt_hex, hash_hex) != 5 ||
+        log_n < 1 || log_n > 20 || r < 1 || r > 32 || p < 1 || p > 16) {
+        return false;
+    }
+    uint8_t salt[SALT_SIZE], expected[HASH_SIZE], actual[HASH_SIZE];
+    if (strlen(salt_hex) != 2 * SALT_SIZE || strlen(hash_hex) != 2 * HASH_SIZE ||
+        !from_hex(salt_hex, salt, sizeof(salt)) || !from_hex(hash_hex, expected, sizeof(expected))) {
+        return false;
+    }
+    scrypt(password, salt, sizeof(salt), log_n, r, p, actual, sizeof(actual));
+    return equal(actual, expected, sizeof(actual));
+}
+
+// 会话令牌：<用户名>:<过期时间（Unix 秒）>:<HMAC hex>，MAC 覆盖 "<用户名>:<过期时间>"。
+// 校验只需要密钥，不需要任何服务端状态
+class TokenSigner {
+public:
+    TokenSigner(const uint8_t *key, size_t len) : hmac(key, len) {}
+
+    std::string sign(const std::string &user, uint64_t expires) const {
+        std::string body = user + ":" + std::to_string(expires);
+        uint8_t mac[32];
+        hmac.mac(body.data(), body.size(), mac);
+        return body + ":" + to_hex(mac, sizeof(mac));
+    }
+
+    // 令牌有效且在 now 时还没过期时返回 true，并给出用户名
+    bool verify(const char *token, size_t len, uint64_t now, std::string *user) const {
+        const char *end = token + len;
+        const char *mac_start = end - 64;
+        if (len < 64 + 4 || mac_start[-1] != ':') {
+            return false;
+        }
+        uint8_t expected[32], actual[32];
+        if (!from_hex(mac_start, expected, sizeof(expected))) {
+            return false;
+        }
+        size_t body_len = mac_start - 1 - token;
+        hmac.mac(token, body_len, actual);
+        if (!equal(actual, expected, sizeof(actual))) {
+            return false;
+        }
+        // MAC 对上了，正文就是自己签的，按格式取出过期时间和用户名
+        const char *colon = static_cast<const char *>(memrchr(token, ':', body_len));
+        if (!colon || strtoull(colon + 1, nullptr, 10) <= now) {
+            return false;
+        }
+        user->assign(token, colon - token);
+        return true;
+    }
+
+private:
+    Hmac hmac;
+};
+
+} // namespace crypto
+
+#endif // AUTH_CRYPTO_H
@@ -2,69 +2,373 @@
 #include <event2/bufferevent.h>
 #include <event2/listener.h>
 #include <event2/buffer.h> // 添加这个头文件，用于缓冲区操作
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "auth_crypto.h"
+#include "framing.h"
+#include "metrics.h"
+#include "workers.h"
 #include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
 #include <cstring>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 #define LISTEN_PORT 5001 // 定义监听端口为5001
+#define METRICS_PORT 6001 // /metrics 监听端口
 
-// 定义一个用户和密码的映射，key是用户名，value是密码
+#define KEY_FILE "auth_token.key" // 令牌签名密钥，第一次启动时随机生成
+#define TOKEN_TTL 86400 // 会话令牌的有效期（秒）
+#define MAX_HASH_JOBS 4096 // 排队等哈希线程的请求上限，再多就直接回 busy
+
+// 用户名到密码哈希的映射（scrypt 加盐哈希，不保存明文）；新用户的哈希串用
+// auth_server --hash <密码> 生成
 std::unordered_map<std::string, std::string> users{
-    {"user1", "password1"},
-    {"user2", "password2"}
+    {"user1", "scrypt$14$8$1$2fcc4c4eb079ab7d8bc924c0fdb0ed8e$37489cb3652cfa74a1aa89cf552c75e84818deb997dfae889efa2567e6739ac3"},
+    {"user2", "scrypt$14$8$1$510f584b67ec1c495df53394f48516d0$f00e21bcd05aa0785c3781b40b03e20f89822bac177e6aee9d63406043b25746"}
 };
 
-// 读取回调函数，当有数据可读时调用
-void read_cb(struct bufferevent *bev, void *ctx) {
-    // 获取输入和输出缓冲区
-    struct evbuffer *input = bufferevent_get_input(bev);
-    struct evbuffer *output = bufferevent_get_output(bev);
-    char buf[1024]; // 定义一个缓冲区，用于存储读取的数据
-    int n = evbuffer_remove(input, buf, sizeof(buf) - 1); // 从输入缓冲区读取数据
-    buf[n] = '\0'; // 将读取的数据转换为字符串，并添加字符串结束符
-
-    std::string response; // 用于存储响应信息
-    std::string request(buf); // 将读取的数据转换为std::string
-
-    // 检查请求是否包含"validate"字符串
-    if (request.find("validate") != std::string::npos) {
-        // 提取用户名和密码
-        std::string user = request.substr(9); // 获取"validate"之后的部分
-        std::string username = user.substr(0, user.find(':')); // 获取用户名
-        std::string password = user.substr(user.find(':') + 1); // 获取密码
-
-        // 验证用户名和密码是否匹配
-        if (users[username] == password) {
-            response = "{\"status\":\"success\"}"; // 如果匹配，返回成功状态
+// 用户不存在时拿来校验的哈希，让回复时间不泄露用户名是否存在
+const char *DUMMY_HASH = "scrypt$14$8$1$00000000000000000000000000000000$"
+                         "0000000000000000000000000000000000000000000000000000000000000000";
+
+crypto::TokenSigner *signer; // 签发和校验令牌，main 里创建后只读，各线程共用
+
+metrics::ServiceMetrics service_metrics("auth_server"); // 本服务的指标
+metrics::Counter password_hashes("auth_password_hashes_total", "Password hashes computed by validate and login",
+                                 service_metrics.labels);
+metrics::Counter token_checks("auth_token_checks_total", "Session tokens checked", service_metrics.labels);
+workers::Pool pool; // --workers N 时的工作线程池
+
+const char *REPLY_FAIL = "{\"status\":\"fail\"}\n";
+const char *REPLY_BUSY = "{\"status\":\"busy\"}\n";
+
+// 一个请求的回复：要哈希密码的请求先占着位置，保证按请求顺序写回
+struct Reply {
+    std::string text;
+    bool done;
+};
+
+// 客户端连接；哈希线程只知道它的编号，连接关了，晚到的回复就找不到人而丢弃
+struct Connection {
+    uint64_t id;
+    struct bufferevent *bev;
+    uint64_t first_seq = 0;         // replies.front() 对应的请求序号
+    uint64_t next_seq = 0;          // 下一个请求的序号
+    std::deque<Reply> replies;
+    bool closing = false;           // 客户端已经关了写端，回复都写完再关
+};
+
+// 哈希线程做完的一个请求
+struct Result {
+    uint64_t conn;
+    uint64_t seq;
+    std::string text;
+};
+
+// 每个事件循环一份：自己的连接，和哈希线程交回来的回复（有新回复时写 wake_fd）
+struct Loop {
+    int wake_fd;
+    struct event *wake_event;
+    std::unordered_map<uint64_t, Connection *> connections;
+    uint64_t next_id = 1;
+    std::mutex mtx;                 // 只保护 results
+    std::vector<Result> results;
+};
+
+thread_local Loop *loop = nullptr; // 当前线程的事件循环状态
+
+// 哈希线程池：scrypt 一次要几十毫秒，放在事件循环上会让同一循环的所有请求
+// （包括 check_token）排在后面。登录和 validate 交给这些线程，事件循环只管收发
+class HashPool {
+public:
+    void start(int count) {
+        for (int i = 0; i < count; i++) {
+            threads.emplace_back([this] { run(); });
+        }
+    }
+
+    // 交一个任务；排队的太多时返回 false
+    bool submit(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> guard(mtx);
+            if (jobs.size() >= MAX_HASH_JOBS) {
+                return false;
+            }
+            jobs.push_back(std::move(job));
+        }
+        ready.notify_one();
+        return true;
+    }
+
+    // 做完已经排队的任务后停止
+    void stop() {
+        {
+            std::lock_guard<std::mutex> guard(mtx);
+            stopping = true;
+        }
+        ready.notify_all();
+        for (auto &th : threads) {
+            th.join();
+        }
+        threads.clear();
+    }
+
+private:
+    std::mutex mtx;
+    std::condition_variable ready;
+    std::deque<std::function<void()>> jobs;
+    bool stopping = false;
+    std::vector<std::thread> threads;
+
+    void run() {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> guard(mtx);
+                ready.wait(guard, [this] { return !jobs.empty() || stopping; });
+                if (jobs.empty()) {
+                    return;
+                }
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+};
+
+HashPool hash_pool; // 校验密码的线程，所有事件循环共用
+
+// 读取令牌签名密钥，不存在就生成一个（只有本用户可读）；重启后已发出的令牌仍然有效
+bool load_token_key(uint8_t key[32]) {
+    int fd = open(KEY_FILE, O_RDONLY | O_CLOEXEC);
+    if (fd != -1) {
+        bool ok = read(fd, key, 32) == 32;
+        close(fd);
+        if (!ok) {
+            std::cerr << "密钥文件 " << KEY_FILE << " 损坏" << std::endl;
+        }
+        return ok;
+    }
+    if (!crypto::random_bytes(key, 32)) {
+        std::cerr << "无法生成令牌密钥" << std::endl;
+        return false;
+    }
+    fd = open(KEY_FILE, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    bool ok = fd != -1 && write(fd, key, 32) == 32;
+    if (fd != -1) {
+        close(fd);
+    }
+    if (!ok) {
+        std::cerr << "无法写入密钥文件 " << KEY_FILE << ": " << strerror(errno) << std::endl;
+    }
+    return ok;
+}
+
+// 校验 "用户名:密码"，成功时给出用户名。这是慢路径（一次 scrypt），只在登录时走
+bool check_password(const std::string &credentials, std::string *username) {
+    size_t colon = credentials.find(':');
+    *username = credentials.substr(0, colon); // 获取用户名
+    std::string password = colon == std::string::npos ? "" : credentials.substr(colon + 1); // 获取密码
+    password_hashes.inc();
+    auto it = users.find(*username); // 只查不插，多个工作线程可以同时读这张表
+    bool match = crypto::verify_password(password, it != users.end() ? it->second : DUMMY_HASH);
+    return match && it != users.end();
+}
+
+// 把已经有了的回复按顺序写给客户端
+void flush_replies(Connection *conn) {
+    struct evbuffer *output = bufferevent_get_output(conn->bev);
+    while (!conn->replies.empty() && conn->replies.front().done) {
+        evbuffer_add(output, conn->replies.front().text.data(), conn->replies.front().text.size());
+        conn->replies.pop_front();
+        conn->first_seq++;
+    }
+}
+
+// 填上某个请求的回复
+void complete(Connection *conn, uint64_t seq, std::string text) {
+    Reply &reply = conn->replies[seq - conn->first_seq];
+    reply.text = std::move(text);
+    reply.done = true;
+}
+
+// 在哈希线程上校验密码，回复交回 owner 这个事件循环；login 时成功还要签发令牌
+void hash_job(Loop *owner, uint64_t conn, uint64_t seq, const std::string &credentials, bool login) {
+    std::string username;
+    std::string response;
+    if (!check_password(credentials, &username)) {
+        response = REPLY_FAIL;
+    } else if (login) {
+        std::string token = signer->sign(username, time(nullptr) + TOKEN_TTL);
+        response = "{\"status\":\"success\",\"token\":\"" + token + "\"}\n";
+    } else {
+        response = "{\"status\":\"success\"}\n";
+    }
+    bool first;
+    {
+        std::lock_guard<std::mutex> guard(owner->mtx);
+        first = owner->results.empty();
+        owner->results.push_back(Result{conn, seq, std::move(response)});
+    }
+    if (first) {
+        uint64_t one = 1;
+        ssize_t n = write(owner->wake_fd, &one, sizeof(one));
+        (void)n;
+    }
+}
+
+// 处理一行请求（不含行尾），回复按序号填进 conn->replies；check_token 当场
+// 回复，要哈希密码的请求交给哈希线程
+void handle_request(Connection *conn, uint64_t seq, const char *line, size_t len) {
+    std::string username;
+    std::string credentials;
+    bool login = false;
+
+    if (framing::starts_with(line, len, "check_token ")) {
+        // check_token <令牌>：只验 MAC 和有效期，不查表、不哈希密码
+        token_checks.inc();
+        if (signer->verify(line + 12, len - 12, time(nullptr), &username)) {
+            complete(conn, seq, "{\"status\":\"success\",\"user\":\"" + username + "\"}\n");
         } else {
-            response = "{\"status\":\"fail\"}"; // 如果不匹配，返回失败状态
+            complete(conn, seq, REPLY_FAIL);
         }
+        return;
+    } else if (framing::starts_with(line, len, "login ")) {
+        // login 用户名:密码：校验一次密码，发一个签名的会话令牌
+        credentials.assign(line + 6, len - 6);
+        login = true;
+    } else if (framing::starts_with(line, len, "validate")) {
+        // validate 用户名:密码：只校验密码，不发令牌
+        size_t skip = std::min<size_t>(9, len);
+        credentials.assign(line + skip, len - skip);
     } else {
-        response = "{\"status\":\"unknown\"}"; // 如果请求格式不对，返回未知状态
+        complete(conn, seq, "{\"status\":\"unknown\"}\n"); // 如果请求格式不对，返回未知状态
+        service_metrics.errors.inc();
+        return;
+    }
+
+    Loop *owner = loop;
+    uint64_t id = conn->id;
+    if (!hash_pool.submit([owner, id, seq, credentials, login] { hash_job(owner, id, seq, credentials, login); })) {
+        complete(conn, seq, REPLY_BUSY); // 哈希线程积压太多：不排队，让客户端稍后再试
+        service_metrics.errors.inc();
+    }
+}
+
+// 关闭连接并释放bufferevent；还在哈希线程上的请求做完后找不到这个编号，回复被丢弃
+void close_connection(Connection *conn) {
+    loop->connections.erase(conn->id);
+    service_metrics.connection_closed(conn->bev);
+    workers::connection_closed();
+    bufferevent_free(conn->bev);
+    delete conn;
+}
+
+// 哈希线程交回了回复：填进各自的位置，按顺序写出
+void results_cb(evutil_socket_t fd, short events, void *ctx) {
+    uint64_t count;
+    ssize_t n = read(fd, &count, sizeof(count));
+    (void)n;
+    std::vector<Result> results;
+    {
+        std::lock_guard<std::mutex> guard(loop->mtx);
+        results.swap(loop->results);
+    }
+    for (Result &result : results) {
+        auto it = loop->connections.find(result.conn);
+        if (it == loop->connections.end()) {
+            continue; // 连接已经关了
+        }
+        complete(it->second, result.seq, std::move(result.text));
+        flush_replies(it->second);
+    }
+}
+
+// 建立当前线程的事件循环状态（每个工作线程各一份）
+void start_loop(struct event_base *base) {
+    loop = new Loop();
+    loop->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    loop->wake_event = event_new(base, loop->wake_fd, EV_READ | EV_PERSIST, results_cb, nullptr);
+    event_add(loop->wake_event, nullptr);
+}
+
+// 读取回调函数，当有数据可读时调用：缓冲区里有几个完整的请求就处理几个
+void read_cb(struct bufferevent *bev, void *ctx) {
+    auto *conn = static_cast<Connection *>(ctx);
+    struct evbuffer *input = bufferevent_get_input(bev);
+    bool ok = framing::for_each_line(input, [conn](const char *line, size_t len, size_t bytes) {
+        auto start = std::chrono::steady_clock::now(); // 请求开始处理的时间
+        uint64_t seq = conn->next_seq++;
+        conn->replies.push_back(Reply{std::string(), false});
+        handle_request(conn, seq, line, len);
+        service_metrics.request_done(bytes, start);
+    });
+    flush_replies(conn);
+    if (!ok) {
+        service_metrics.errors.inc(); // 一行长得离谱：不是正常客户端，断开
+        close_connection(conn);
     }
+}
 
-    // 将响应信息添加到输出缓冲区
-    evbuffer_add(output, response.c_str(), response.size());
+// 写回调：输出缓冲区写空时调用；半关闭的连接等所有回复写完后再关
+void write_cb(struct bufferevent *bev, void *ctx) {
+    auto *conn = static_cast<Connection *>(ctx);
+    if (conn->closing && conn->replies.empty()) {
+        close_connection(conn);
+    }
 }
 
 // 事件回调函数，当连接发生错误或结束时调用
 void event_cb(struct bufferevent *bev, short events, void *ctx) {
+    auto *conn = static_cast<Connection *>(ctx);
     if (events & BEV_EVENT_ERROR) {
         std::cerr << "Error from bufferevent" << std::endl; // 如果发生错误，输出错误信息
+        service_metrics.errors.inc();
+        close_connection(conn);
+        return;
     }
-    if (events & (BEV_EVENT_EOF | BEV_EVENT_ERROR)) {
-        bufferevent_free(bev); // 如果连接结束或发生错误，释放bufferevent
+    if (events & BEV_EVENT_EOF) {
+        // 客户端只是关了写端：还在哈希的请求的回复照样要发给它
+        if (conn->replies.empty() && evbuffer_get_length(bufferevent_get_output(bev)) == 0) {
+            close_connection(conn);
+            return;
+        }
+        conn->closing = true;
+        bufferevent_disable(bev, EV_READ); // 不再读；回复写完后由 write_cb 关闭
     }
 }
 
-// 接受连接回调函数，当有新的客户端连接时调用
-void accept_conn_cb(struct evconnlistener *listener, evutil_socket_t fd, struct sockaddr *addr, int len, void *ctx) {
-    struct event_base *base = evconnlistener_get_base(listener); // 获取事件基础
+// 在 base 上为新连接建立 bufferevent（单线程时在主线程，否则在分到的工作线程上）
+void start_connection(struct event_base *base, evutil_socket_t fd, void *ctx) {
     struct bufferevent *bev = bufferevent_socket_new(base, fd, BEV_OPT_CLOSE_ON_FREE); // 为新连接创建一个bufferevent
-    bufferevent_setcb(bev, read_cb, nullptr, event_cb, nullptr); // 设置bufferevent的回调函数
+    auto *conn = new Connection();
+    conn->id = loop->next_id++;
+    conn->bev = bev;
+    loop->connections[conn->id] = conn;
+    bufferevent_setcb(bev, read_cb, write_cb, event_cb, conn); // 设置bufferevent的回调函数
+    service_metrics.connection_opened(bev); // 统计连接并跟踪输出队列
     bufferevent_enable(bev, EV_READ | EV_WRITE); // 启用读写事件
 }
 
+// 接受连接回调函数，当有新的客户端连接时调用
+void accept_conn_cb(struct evconnlistener *listener, evutil_socket_t fd, struct sockaddr *addr, int len, void *ctx) {
+    if (pool.running()) {
+        pool.dispatch(fd); // 交给连接最少的工作线程
+        return;
+    }
+    start_connection(evconnlistener_get_base(listener), fd, nullptr);
+}
+
 // 接受错误回调函数，当监听器发生错误时调用
 void accept_error_cb(struct evconnlistener *listener, void *ctx) {
     struct event_base *base = evconnlistener_get_base(listener); // 获取事件基础
@@ -73,7 +377,30 @@ void accept_error_cb(struct evconnlistener *listener, void *ctx) {
     event_base_loopexit(base, nullptr); // 退出事件循环
 }
 
-int main() {
+int main(int argc, char **argv) {
+    // auth_server --hash <密码>：输出可以填进 users 的哈希串
+    if (argc == 3 && strcmp(argv[1], "--hash") == 0) {
+        std::cout << crypto::hash_password(argv[2]) << std::endl;
+        return 0;
+    }
+    int worker_count = workers::parse_workers(argc, argv); // --workers N
+    // --hash-threads N：校验密码的线程数，默认每个 CPU 一个
+    int hash_threads = static_cast<int>(std::thread::hardware_concurrency());
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--hash-threads") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            hash_threads = atoi(argv[++i]);
+        } else {
+            std::cerr << "用法: auth_server [--workers N] [--hash-threads N] | --hash <密码>" << std::endl;
+            return 1;
+        }
+    }
+    hash_threads = std::max(hash_threads, 1);
+    uint8_t key[32];
+    if (!load_token_key(key)) {
+        return 1;
+    }
+    crypto::TokenSigner token_signer(key, sizeof(key));
+    signer = &token_signer;
     struct event_base *base; // 定义事件基础
     struct evconnlistener *listener; // 定义连接监听器
     struct sockaddr_in sin; // 定义地址结构体
@@ -99,8 +426,20 @@ int main() {
         return 1;
     }
     evconnlistener_set_error_cb(listener, accept_error_cb); // 设置监听器的错误回调函数
+    metrics::serve(base, METRICS_PORT); // 在同一个事件循环里提供 /metrics
+    hash_pool.start(hash_threads);
+    // 每个事件循环都要接收哈希线程的回复；有工作线程时连接都在工作线程上
+    if (worker_count > 0) {
+        if (!pool.start(worker_count, start_connection, nullptr, start_loop)) {
+            return 1;
+        }
+    } else {
+        start_loop(base);
+    }
 
     event_base_dispatch(base); // 进入事件循环
+    pool.stop(); // 等工作线程退出
+    hash_pool.stop(); // 做完排队的哈希
     evconnlistener_free(listener); // 释放监听器
     event_base_free(base); // 释放事件基础
 
@@ -6,37 +6,140 @@
 #include <vector>
 #include <string>
 #include <event2/buffer.h> // 添加这个头文件，用于缓冲区操作
+#include "framing.h"
+#include "metrics.h"
+#include "message_store.h"
+#include "workers.h"
 
 #define LISTEN_PORT 5002 // 定义监听端口为5002
+#define METRICS_PORT 6002 // /metrics 监听端口
+#define DATA_DIR "chat_data" // 消息日志所在目录（可用第一个命令行参数覆盖）
+#define HISTORY_PAGE 100 // /history 默认每页的消息条数
+#define HISTORY_MAX_PAGE 1000 // 每页最多的消息条数
 
-std::vector<std::string> messages; // 存储消息的容器
+store::MessageLog messages; // 存储消息的日志，重启后仍在；各工作线程直接并发读写
+workers::Pool pool; // --workers N 时的工作线程池
 
-// 读取回调函数，当有数据可读时调用
+metrics::ServiceMetrics service_metrics("chat_server"); // 本服务的指标
+metrics::Gauge history_size("chat_history_messages", "Messages kept in history", service_metrics.labels,
+                            [] { return static_cast<double>(messages.size()); }); // 抓取时读取
+metrics::Gauge store_size("chat_store_bytes", "Bytes of message log segments on disk", service_metrics.labels,
+                          [] { return static_cast<double>(messages.disk_bytes()); });
+
+// 从请求里 "?" 之后的查询串取一个数字参数，如 since=42；没有就返回 fallback
+uint64_t query_param(const std::string &request, const char *key, uint64_t fallback) {
+    size_t query = request.find('?');
+    if (query == std::string::npos) {
+        return fallback;
+    }
+    std::string name = std::string(key) + "=";
+    for (size_t pos = query + 1; pos < request.size();) {
+        size_t end = request.find_first_of("& \r\n", pos);
+        if (end == std::string::npos) {
+            end = request.size();
+        }
+        if (request.compare(pos, name.size(), name) == 0) {
+            return strtoull(request.c_str() + pos + name.size(), nullptr, 10);
+        }
+        if (end == request.size() || request[end] != '&') {
+            break; // 查询串到此结束
+        }
+        pos = end + 1;
+    }
+    return fallback;
+}
+
+// 把一段文本作为 JSON 字符串写进 output：不需要转义的连续字节一次写入
+void add_json_string(struct evbuffer *output, const char *data, size_t len) {
+    evbuffer_add(output, "\"", 1);
+    size_t run = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = data[i];
+        if (c != '"' && c != '\\' && c >= 0x20) {
+            continue;
+        }
+        evbuffer_add(output, data + run, i - run);
+        if (c == '"' || c == '\\') {
+            char escaped[2] = {'\\', static_cast<char>(c)};
+            evbuffer_add(output, escaped, 2);
+        } else {
+            evbuffer_add_printf(output, "\\u%04x", c);
+        }
+        run = i + 1;
+    }
+    evbuffer_add(output, data + run, len - run);
+    evbuffer_add(output, "\"", 1);
+}
+
+// 把编号大于 since 的至多 limit 条消息写成一页 JSON：
+// {"messages":[{"seq":1,"text":"..."},...],"next_cursor":"1","more":false}
+// 消息从段文件的映射（页缓存）里逐条写进输出缓冲区，不拼整页的字符串，
+// 开销只和页大小有关。next_cursor 作为下一次请求的 cursor（或 since）即可接着读
+void add_history_page(struct evbuffer *output, uint64_t since, size_t limit) {
+    uint64_t last = since;
+    bool first = true;
+    evbuffer_add(output, "{\"messages\":[", 13);
+    messages.scan(since + 1, limit, [output, &last, &first](uint64_t seq, const char *data, size_t len) {
+        evbuffer_add_printf(output, "%s{\"seq\":%llu,\"text\":", first ? "" : ",",
+                            static_cast<unsigned long long>(seq));
+        first = false;
+        add_json_string(output, data, len);
+        evbuffer_add(output, "}", 1);
+        last = seq;
+        return true;
+    });
+    // 超过最新消息的游标（如消息目录被清空过）退回到最新一条
+    last = std::min(last, messages.next_seq() - 1);
+    evbuffer_add_printf(output, "],\"next_cursor\":\"%llu\",\"more\":%s}\n", static_cast<unsigned long long>(last),
+                        last + 1 < messages.next_seq() ? "true" : "false");
+}
+
+// 处理一行请求（不含行尾），回复写进 output；每个请求都回复一行
+void handle_request(const char *line, size_t len, struct evbuffer *output) {
+    // 检查请求是否以"/send"开头
+    if (framing::starts_with(line, len, "/send")) {
+        // "/send "之后的部分作为消息内容，直接从输入缓冲区追加到消息日志，不另外拷贝
+        size_t skip = std::min<size_t>(6, len);
+        if (messages.append(line + skip, len - skip) == 0) {
+            service_metrics.errors.inc();
+            evbuffer_add(output, "{\"status\":\"error\"}\n", 19);
+        } else {
+            evbuffer_add(output, "{\"status\":\"success\"}\n", 21); // 返回成功状态
+        }
+    }
+    // 检查请求是否以"/history"开头
+    // 分页读取：/history?since=<seq>&limit=<n>，或带上一页的 cursor=<next_cursor>
+    else if (framing::starts_with(line, len, "/history")) {
+        std::string request(line, len);
+        uint64_t since = query_param(request, "cursor", query_param(request, "since", 0));
+        uint64_t limit = query_param(request, "limit", HISTORY_PAGE);
+        add_history_page(output, since, std::min<uint64_t>(std::max<uint64_t>(limit, 1), HISTORY_MAX_PAGE));
+    } else {
+        service_metrics.errors.inc(); // 无法识别的请求
+        evbuffer_add(output, "{\"status\":\"unknown\"}\n", 21);
+    }
+}
+
+// 关闭连接并释放bufferevent
+void close_connection(struct bufferevent *bev) {
+    service_metrics.connection_closed(bev);
+    workers::connection_closed();
+    bufferevent_free(bev);
+}
+
+// 读取回调函数，当有数据可读时调用：缓冲区里有几个完整的请求就处理几个
 void read_cb(struct bufferevent *bev, void *ctx) {
     // 获取输入和输出缓冲区
     struct evbuffer *input = bufferevent_get_input(bev);
     struct evbuffer *output = bufferevent_get_output(bev);
-    char buf[1024]; // 定义一个缓冲区，用于存储读取的数据
-    int n = evbuffer_remove(input, buf, sizeof(buf) - 1); // 从输入缓冲区读取数据
-    buf[n] = '\0'; // 将读取的数据转换为字符串，并添加字符串结束符
-
-    std::string request(buf); // 将读取的数据转换为std::string
-
-    // 检查请求是否包含"/send"字符串
-    if (request.find("/send") != std::string::npos) {
-        std::string message = request.substr(6); // 获取"/send"之后的部分作为消息内容
-        messages.push_back(message); // 将消息内容添加到消息列表
-        evbuffer_add(output, "{\"status\":\"success\"}", 19); // 返回成功状态
-    } 
-    // 检查请求是否包含"/history"字符串
-    else if (request.find("/history") != std::string::npos) {
-        std::string response = "{\"messages\":["; // 构建JSON格式的响应
-        for (const auto& msg : messages) {
-            response += "\"" + msg + "\","; // 将每条消息添加到响应中
-        }
-        if (!messages.empty()) response.pop_back(); // 移除最后一个多余的逗号
-        response += "]}"; // 完成响应的构建
-        evbuffer_add(output, response.c_str(), response.size()); // 将响应添加到输出缓冲区
+    bool ok = framing::for_each_line(input, [output](const char *line, size_t len, size_t bytes) {
+        auto start = std::chrono::steady_clock::now(); // 请求开始处理的时间
+        handle_request(line, len, output);
+        service_metrics.request_done(bytes, start);
+    });
+    if (!ok) {
+        service_metrics.errors.inc(); // 一行长得离谱：不是正常客户端，断开
+        close_connection(bev);
     }
 }
 
@@ -44,20 +147,30 @@ void read_cb(struct bufferevent *bev, void *ctx) {
 void event_cb(struct bufferevent *bev, short events, void *ctx) {
     if (events & BEV_EVENT_ERROR) {
         std::cerr << "Error from bufferevent" << std::endl; // 如果发生错误，输出错误信息
+        service_metrics.errors.inc();
     }
     if (events & (BEV_EVENT_EOF | BEV_EVENT_ERROR)) {
-        bufferevent_free(bev); // 如果连接结束或发生错误，释放bufferevent
+        close_connection(bev); // 如果连接结束或发生错误，释放bufferevent
     }
 }
 
-// 接受连接回调函数，当有新的客户端连接时调用
-void accept_conn_cb(struct evconnlistener *listener, evutil_socket_t fd, struct sockaddr *addr, int len, void *ctx) {
-    struct event_base *base = evconnlistener_get_base(listener); // 获取事件基础
+// 在 base 上为新连接建立 bufferevent（单线程时在主线程，否则在分到的工作线程上）
+void start_connection(struct event_base *base, evutil_socket_t fd, void *ctx) {
     struct bufferevent *bev = bufferevent_socket_new(base, fd, BEV_OPT_CLOSE_ON_FREE); // 为新连接创建一个bufferevent
     bufferevent_setcb(bev, read_cb, nullptr, event_cb, nullptr); // 设置bufferevent的回调函数
+    service_metrics.connection_opened(bev); // 统计连接并跟踪输出队列
     bufferevent_enable(bev, EV_READ | EV_WRITE); // 启用读写事件
 }
 
+// 接受连接回调函数，当有新的客户端连接时调用
+void accept_conn_cb(struct evconnlistener *listener, evutil_socket_t fd, struct sockaddr *addr, int len, void *ctx) {
+    if (pool.running()) {
+        pool.dispatch(fd); // 交给连接最少的工作线程
+        return;
+    }
+    start_connection(evconnlistener_get_base(listener), fd, nullptr);
+}
+
 // 接受错误回调函数，当监听器发生错误时调用
 void accept_error_cb(struct evconnlistener *listener, void *ctx) {
     struct event_base *base = evconnlistener_get_base(listener); // 获取事件基础
@@ -66,11 +179,23 @@ void accept_error_cb(struct evconnlistener *listener, void *ctx) {
     event_base_loopexit(base, nullptr); // 退出事件循环
 }
 
-int main() {
+// 定时回调：把这段时间追加的消息刷到磁盘
+void sync_cb(evutil_socket_t fd, short events, void *ctx) {
+    messages.sync();
+}
+
+int main(int argc, char **argv) {
+    int worker_count = workers::parse_workers(argc, argv); // --workers N，其余参数照旧
     struct event_base *base; // 定义事件基础
     struct evconnlistener *listener; // 定义连接监听器
     struct sockaddr_in sin; // 定义地址结构体
 
+    // 打开消息日志，恢复上次运行留下的消息
+    if (!messages.open(argc > 1 ? argv[1] : DATA_DIR)) {
+        return 1;
+    }
+    std::cout << "消息日志已恢复 " << messages.size() << " 条消息" << std::endl;
+
     base = event_base_new(); // 创建一个新的事件基础
     if (!base) {
         std::cerr << "Could not initialize libevent!" << std::endl; // 如果创建失败，输出错误信息
@@ -92,8 +217,20 @@ int main() {
         return 1;
     }
     evconnlistener_set_error_cb(listener, accept_error_cb); // 设置监听器的错误回调函数
+    metrics::serve(base, METRICS_PORT); // 在同一个事件循环里提供 /metrics
+
+    // 每秒刷一次盘：进程崩溃不丢消息，掉电最多丢最后一秒
+    struct event *sync_event = event_new(base, -1, EV_PERSIST, sync_cb, nullptr);
+    struct timeval interval = {1, 0};
+    event_add(sync_event, &interval);
+    if (worker_count > 0 && !pool.start(worker_count, start_connection)) {
+        return 1;
+    }
 
     event_base_dispatch(base); // 进入事件循环
+    pool.stop(); // 等工作线程退出，之后再做最后一次刷盘
+    event_free(sync_event);
+    messages.sync();
     evconnlistener_free(listener); // 释放监听器
     event_base_free(base); // 释放事件基础
 
@@ -6,12 +6,18 @@
 #include <cstring>
 #include <vector>
 #include <algorithm> // 需要包含这个头文件
+#include "framing.h"
+#include "metrics.h"
+#include "workers.h"
 
 #define DB_SERVER_PORT 5558
+#define METRICS_PORT 6558 // /metrics 监听端口
+
+metrics::ServiceMetrics service_metrics("db_server"); // 本服务的指标
 
 class DatabaseServer {
 public:
-    DatabaseServer() : base(nullptr), listener(nullptr) {}
+    explicit DatabaseServer(int worker_count = 0) : base(nullptr), listener(nullptr), worker_count(worker_count) {}
 
     void start(int port) {
         // 初始化 libevent 的 event_base
@@ -38,6 +44,9 @@ public:
             return;
         }
 
+        // 在同一个事件循环里提供 /metrics
+        metrics::serve(base, METRICS_PORT);
+
         // 设置信号处理器，处理 SIGINT (Ctrl+C)
         struct event *signal_event;
         signal_event = evsignal_new(base, SIGINT, signal_cb, (void *) base);
@@ -47,10 +56,16 @@ public:
             return;
         }
 
+        // --workers N：连接交给 N 个工作线程，主线程只负责 accept
+        if (worker_count > 0 && !pool.start(worker_count, start_connection, this)) {
+            return;
+        }
+
         std::cout << "数据库服务器启动，监听端口 " << port << std::endl;
 
         // 进入 libevent 的事件循环
         event_base_dispatch(base);
+        pool.stop(); // 等工作线程退出
 
         // 事件循环结束后清理资源
         evconnlistener_free(listener);
@@ -63,7 +78,11 @@ public:
 private:
     struct event_base *base;                     // libevent 的事件基础
     struct evconnlistener *listener;             // 接受连接的监听器
-    std::vector<struct bufferevent *> clients;   // 已连接客户端的 bufferevent 列表
+    int worker_count;                            // 工作线程数，0 表示单线程
+    workers::Pool pool;                          // 工作线程池
+
+    // 已连接客户端的 bufferevent 列表；每个线程只记自己事件循环上的连接
+    static thread_local std::vector<struct bufferevent *> clients;
 
     // SIGINT (Ctrl+C) 信号处理器
     static void signal_cb(evutil_socket_t sig, short events, void *user_data) {
@@ -77,17 +96,26 @@ private:
     static void accept_conn_cb(struct evconnlistener *listener, evutil_socket_t fd, struct sockaddr *address,
                                int socklen, void *ctx) {
         auto *server = static_cast<DatabaseServer *>(ctx);
-        server->accept_connection(listener, fd, address, socklen);
+        if (server->pool.running()) {
+            server->pool.dispatch(fd); // 交给连接最少的工作线程
+            return;
+        }
+        server->accept_connection(server->base, fd);
+    }
+
+    // 在工作线程上建立分到的连接
+    static void start_connection(struct event_base *base, evutil_socket_t fd, void *ctx) {
+        static_cast<DatabaseServer *>(ctx)->accept_connection(base, fd);
     }
 
-    // 处理接受的连接
-    void accept_connection(struct evconnlistener *listener, evutil_socket_t fd, struct sockaddr *address,
-                           int socklen) {
+    // 处理接受的连接，base 是它所属线程的事件循环
+    void accept_connection(struct event_base *base, evutil_socket_t fd) {
         // 创建一个新的 bufferevent 处理与客户端的通信
         auto *bev = bufferevent_socket_new(base, fd, BEV_OPT_CLOSE_ON_FREE);
         bufferevent_setcb(bev, read_cb, nullptr, error_cb, this); // 设置回调函数
         bufferevent_enable(bev, EV_READ | EV_WRITE); // 启用读写事件
         clients.push_back(bev); // 将新的 bufferevent 添加到客户端列表
+        service_metrics.connection_opened(bev); // 统计连接并跟踪输出队列
     }
 
     // 读取数据的回调函数
@@ -96,13 +124,24 @@ private:
         server->handle_read(bev);
     }
 
-    // 处理读取事件
+    // 处理读取事件：每行一个查询，每个查询回复一行
     void handle_read(struct bufferevent *bev) {
-        // 模拟数据库查询处理
-        const char *query_result = "查询结果: 来自数据库服务器的问候!\n";
-
-        // 将查询结果发送回客户端
-        bufferevent_write(bev, query_result, strlen(query_result));
+        struct evbuffer *input = bufferevent_get_input(bev);
+        bool ok = framing::for_each_line(input, [bev](const char *line, size_t len, size_t bytes) {
+            auto start = std::chrono::steady_clock::now(); // 请求开始处理的时间
+
+            // 模拟数据库查询处理
+            const char *query_result = "查询结果: 来自数据库服务器的问候!\n";
+
+            // 将查询结果发送回客户端
+            bufferevent_write(bev, query_result, strlen(query_result));
+            service_metrics.request_done(bytes, start);
+        });
+        if (!ok) {
+            // 一行长得离谱：不是正常客户端，断开
+            service_metrics.errors.inc();
+            close_connection(bev);
+        }
     }
 
     // 错误处理的回调函数
@@ -111,6 +150,18 @@ private:
         server->handle_error(bev, error);
     }
 
+    // 从客户端列表中移除 bufferevent 并释放资源
+    void close_connection(struct bufferevent *bev) {
+        auto it = std::find(clients.begin(), clients.end(), bev);
+        if (it != clients.end()) {
+            clients.erase(it);
+        }
+
+        service_metrics.connection_closed(bev);
+        workers::connection_closed();
+        bufferevent_free(bev);
+    }
+
     // 处理连接错误
     void handle_error(struct bufferevent *bev, short error) {
         // 处理不同类型的错误
@@ -118,23 +169,20 @@ private:
             std::cout << "连接关闭。" << std::endl;
         } else if (error & BEV_EVENT_ERROR) {
             std::cerr << "连接发生错误: " << strerror(errno) << std::endl;
+            service_metrics.errors.inc();
         } else if (error & BEV_EVENT_TIMEOUT) {
             std::cout << "连接超时。" << std::endl;
         }
 
-        // 从客户端列表中移除 bufferevent 并释放资源
-        auto it = std::find(clients.begin(), clients.end(), bev);
-        if (it != clients.end()) {
-            clients.erase(it);
-        }
-
-        bufferevent_free(bev);
+        close_connection(bev);
     }
 };
 
+thread_local std::vector<struct bufferevent *> DatabaseServer::clients;
+
 // 程序入口
-int main() {
-    DatabaseServer dbServer;
+int main(int argc, char **argv) {
+    DatabaseServer dbServer(workers::parse_workers(argc, argv));
     dbServer.start(DB_SERVER_PORT); // 启动数据库服务器
 
     return 0;
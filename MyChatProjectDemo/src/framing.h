@@ -0,0 +1,46 @@
+#ifndef FRAMING_H
+#define FRAMING_H
+
+#include <event2/buffer.h>
+#include <cstring>
+
+// 各服务共用的请求分帧（仅头文件）。请求按行发送，行尾是 "\n" 或 "\r\n"；
+// 一次读回调里可能有好几个请求，也可能只有半个，半行留在输入缓冲区里等下次。
+namespace framing {
+
+const size_t MAX_LINE = 65536; // 一行请求的最大长度
+
+// 对 input 里每个完整的行调用 fn(line, len, bytes)：line/len 是不含行尾的内容，
+// bytes 是连同行尾一共消耗的字节。处理完的行从 input 移除，空行跳过。
+// 行落在 evbuffer 的同一个内存块里时 line 直接指向那块数据，不拷贝；只有跨块
+// 的行才由 evbuffer_pullup 拼成连续的。line 只在 fn 返回前有效。
+// 返回 false 表示有一行超过了 MAX_LINE（不是正常的客户端），调用者应断开连接
+template <typename F>
+bool for_each_line(struct evbuffer *input, F fn) {
+    while (true) {
+        size_t eol_len = 0;
+        struct evbuffer_ptr eol = evbuffer_search_eol(input, nullptr, &eol_len, EVBUFFER_EOL_CRLF);
+        if (eol.pos < 0) {
+            return evbuffer_get_length(input) <= MAX_LINE;
+        }
+        size_t len = eol.pos;
+        if (len > MAX_LINE) {
+            return false;
+        }
+        if (len > 0) {
+            const char *line = reinterpret_cast<const char *>(evbuffer_pullup(input, len));
+            fn(line, len, len + eol_len);
+        }
+        evbuffer_drain(input, len + eol_len);
+    }
+}
+
+// line 是否以 prefix 开头
+inline bool starts_with(const char *line, size_t len, const char *prefix) {
+    size_t n = strlen(prefix);
+    return len >= n && memcmp(line, prefix, n) == 0;
+}
+
+} // namespace framing
+
+#endif // FRAMING_H
@@ -1,38 +1,444 @@
 #include <event2/event.h>
 #include <event2/bufferevent.h>
 #include <event2/listener.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
 #include <iostream>
 #include <cstring>
+#include <deque>
+#include <unordered_map>
+#include <vector>
 #include <event2/buffer.h> // 添加这个头文件，用于缓冲区操作
+#include "framing.h"
+#include "metrics.h"
+#include "workers.h"
 
 #define LISTEN_PORT 5555 // 定义监听端口为5555
+#define METRICS_PORT 6555 // /metrics 监听端口
+#define BACKEND_ADDR "127.0.0.1" // 后端服务所在的地址
+#define POOL_SIZE 4 // 每个后端保持的长连接数
+#define PIPELINE_DEPTH 16 // 每条后端连接上同时在途的请求数；后端按行分帧，回复按请求顺序
+#define MAX_WAITING 4096 // 每个后端等待空闲连接的请求上限，再多就直接回复繁忙
+#define RECONNECT_SECONDS 1 // 后端连接断开后重连的间隔
 
-// 读取回调函数，当有数据可读时调用
+// 网关协议：客户端每行一个请求，网关按命令前缀转给对应的后端，每个请求回复一行，
+// 按请求的顺序回复（即使它们去了不同的后端）。到后端的连接是预先建好的长连接池，
+// 请求不再为握手付出一个往返。
+//
+// --workers N 时每个工作线程有一份自己的网关状态（客户端表和各后端的连接池），
+// 客户端和它的请求始终在同一个线程上，线程之间不共享任何可变状态。
+
+const char *REPLY_UNKNOWN = "{\"status\":\"unknown\"}\n";
+const char *REPLY_UNAVAILABLE = "{\"status\":\"unavailable\"}\n";
+const char *REPLY_BUSY = "{\"status\":\"busy\"}\n";
+
+metrics::ServiceMetrics service_metrics("gateway_server"); // 本服务的指标
+workers::Pool pool; // --workers N 时的工作线程池
+
+struct Service;
+
+// 等待后端回复的一个请求：哪个客户端的第几个请求
+struct Pending {
+    uint64_t client;
+    uint64_t seq;
+};
+
+// 到后端的一条长连接；inflight 是已发出、还没收到回复的请求，回复按发出的顺序到达
+struct BackendConn {
+    Service *service;
+    struct bufferevent *bev = nullptr;
+    bool up = false;                // 已连上，可以发请求
+    std::deque<Pending> inflight;
+    struct event *retry = nullptr;  // 重连定时器
+};
+
+// 在队列里等空闲连接的请求，请求行已经移到 line 里
+struct Waiting {
+    Pending pending;
+    struct evbuffer *line;
+};
+
+// 一个后端服务的地址和指标，所有线程共用（指标本身按线程分片）
+struct Backend {
+    const char *name;
+    int port;
+    metrics::Counter routed;        // 转发给它的请求
+    metrics::Counter failed;        // 因它不可用或繁忙而失败的请求
+
+    Backend(const char *name, int port)
+        : name(name), port(port),
+          routed("gateway_routed_total", "Requests forwarded to a backend",
+                 service_metrics.labels + ",backend=\"" + name + "\""),
+          failed("gateway_backend_failures_total", "Requests failed because the backend was down or busy",
+                 service_metrics.labels + ",backend=\"" + name + "\"") {}
+};
+
+enum { AUTH, CHAT, LOG, DB, BACKEND_COUNT };
+
+Backend backends[BACKEND_COUNT] = {
+    {"auth", 5001},
+    {"chat", 5002},
+    {"log", 5003},
+    {"db", 5558},
+};
+
+// 一个事件循环里的一个后端服务：连接池和等待空闲连接的请求
+struct Service {
+    Backend *backend;
+    std::vector<BackendConn *> pool;
+    std::deque<Waiting> waiting;
+};
+
+// 路由表：请求行以 prefix 开头就交给 backends[backend]
+struct Route {
+    const char *prefix;
+    int backend;
+};
+
+const Route routes[] = {
+    {"validate", AUTH},
+    {"login", AUTH},
+    {"check_token", AUTH},
+    {"/send", CHAT},
+    {"/history", CHAT},
+    {"/log", LOG},
+    {"query", DB},
+};
+
+// 一个请求的回复：到齐之前先占着位置，保证按请求顺序写回
+struct Reply {
+    struct evbuffer *data;
+    bool done;
+};
+
+// 客户端连接
+struct Client {
+    uint64_t id;
+    struct bufferevent *bev;
+    uint64_t first_seq = 0;         // replies.front() 对应的请求序号
+    uint64_t next_seq = 0;          // 下一个请求的序号
+    std::deque<Reply> replies;
+    bool closing = false;           // 客户端已经关了写端，回复都写完再关
+};
+
+// 一个事件循环的网关状态：单线程时只有一份，否则每个工作线程一份
+struct Gateway {
+    struct event_base *base;
+    Service services[BACKEND_COUNT];
+    std::unordered_map<uint64_t, Client *> clients; // 编号 -> 客户端；后端回复按编号找人，客户端走了就丢弃
+    uint64_t next_client_id = 1;
+};
+
+thread_local Gateway *gateway = nullptr; // 当前线程的网关状态
+
+void connect_backend(BackendConn *conn);
+
+// 把已经到齐的回复按顺序写给客户端
+void flush_replies(Client *client) {
+    struct evbuffer *output = bufferevent_get_output(client->bev);
+    while (!client->replies.empty() && client->replies.front().done) {
+        evbuffer_add_buffer(output, client->replies.front().data);
+        evbuffer_free(client->replies.front().data);
+        client->replies.pop_front();
+        client->first_seq++;
+    }
+}
+
+// 关闭客户端连接；还在后端的请求的回复到达时找不到这个编号，会被丢弃
+void close_client(Client *client) {
+    gateway->clients.erase(client->id);
+    for (Reply &reply : client->replies) {
+        evbuffer_free(reply.data);
+    }
+    service_metrics.connection_closed(client->bev);
+    workers::connection_closed();
+    bufferevent_free(client->bev);
+    delete client;
+}
+
+// 找到客户端某个请求的回复位置；客户端已经断开则返回 nullptr
+Reply *find_reply(const Pending &pending) {
+    auto it = gateway->clients.find(pending.client);
+    if (it == gateway->clients.end()) {
+        return nullptr;
+    }
+    return &it->second->replies[pending.seq - it->second->first_seq];
+}
+
+// 用网关自己生成的一行结束一个请求
+void fail_request(const Pending &pending, const char *reply) {
+    if (Reply *slot = find_reply(pending)) {
+        evbuffer_add(slot->data, reply, strlen(reply));
+        slot->done = true;
+        flush_replies(gateway->clients[pending.client]);
+    }
+}
+
+// 选一条能再发请求的连接：已连上、在途最少的那条
+BackendConn *pick_conn(Service *service) {
+    BackendConn *best = nullptr;
+    for (BackendConn *conn : service->pool) {
+        if (conn->up && conn->inflight.size() < PIPELINE_DEPTH &&
+            (!best || conn->inflight.size() < best->inflight.size())) {
+            best = conn;
+        }
+    }
+    return best;
+}
+
+// 服务是否还有连上或正在连的连接；都没有时请求不必排队等
+bool reachable(Service *service) {
+    for (BackendConn *conn : service->pool) {
+        if (conn->bev) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 把一行请求（已带换行）发到连接上，evbuffer 之间只移动数据块，不拷贝
+void send_request(BackendConn *conn, const Pending &pending, struct evbuffer *line) {
+    conn->inflight.push_back(pending);
+    evbuffer_add_buffer(bufferevent_get_output(conn->bev), line);
+    conn->service->backend->routed.inc();
+}
+
+// 有连接空出来时，把等待的请求发出去
+void drain_waiting(Service *service) {
+    while (!service->waiting.empty()) {
+        BackendConn *conn = pick_conn(service);
+        if (!conn) {
+            return;
+        }
+        Waiting waiting = service->waiting.front();
+        service->waiting.pop_front();
+        send_request(conn, waiting.pending, waiting.line);
+        evbuffer_free(waiting.line);
+    }
+}
+
+// 后端回复：每行对应 inflight 队首的请求
+void backend_read_cb(struct bufferevent *bev, void *ctx) {
+    auto *conn = static_cast<BackendConn *>(ctx);
+    struct evbuffer *input = bufferevent_get_input(bev);
+    while (!conn->inflight.empty()) {
+        size_t eol_len = 0;
+        struct evbuffer_ptr eol = evbuffer_search_eol(input, nullptr, &eol_len, EVBUFFER_EOL_LF);
+        if (eol.pos < 0) {
+            break;
+        }
+        Pending pending = conn->inflight.front();
+        conn->inflight.pop_front();
+        if (Reply *slot = find_reply(pending)) {
+            evbuffer_remove_buffer(input, slot->data, eol.pos + eol_len);
+            slot->done = true;
+            flush_replies(gateway->clients[pending.client]);
+        } else {
+            evbuffer_drain(input, eol.pos + eol_len);
+        }
+    }
+    if (conn->inflight.empty()) {
+        evbuffer_drain(input, evbuffer_get_length(input)); // 没人等的字节（协议错误）丢掉
+    }
+    drain_waiting(conn->service);
+}
+
+// 重连定时器
+void retry_cb(evutil_socket_t fd, short events, void *ctx) {
+    connect_backend(static_cast<BackendConn *>(ctx));
+}
+
+// 后端连接的事件：连上了就开始发请求，断了就让在途请求失败并稍后重连
+void backend_event_cb(struct bufferevent *bev, short events, void *ctx) {
+    auto *conn = static_cast<BackendConn *>(ctx);
+    if (events & BEV_EVENT_CONNECTED) {
+        int one = 1;
+        setsockopt(bufferevent_getfd(bev), IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        conn->up = true;
+        drain_waiting(conn->service);
+        return;
+    }
+    if (!(events & (BEV_EVENT_EOF | BEV_EVENT_ERROR))) {
+        return;
+    }
+    if (conn->up) {
+        std::cerr << "后端 " << conn->service->backend->name << " 连接断开" << std::endl;
+    }
+    conn->up = false;
+    bufferevent_free(conn->bev);
+    conn->bev = nullptr;
+    std::deque<Pending> lost;
+    lost.swap(conn->inflight);
+    for (const Pending &pending : lost) {
+        conn->service->backend->failed.inc();
+        fail_request(pending, REPLY_UNAVAILABLE);
+    }
+    // 整个服务都连不上时，等着的请求也不必再等
+    while (!reachable(conn->service) && !conn->service->waiting.empty()) {
+        Waiting waiting = conn->service->waiting.front();
+        conn->service->waiting.pop_front();
+        evbuffer_free(waiting.line);
+        conn->service->backend->failed.inc();
+        fail_request(waiting.pending, REPLY_UNAVAILABLE);
+    }
+    struct timeval delay = {RECONNECT_SECONDS, 0};
+    event_add(conn->retry, &delay);
+}
+
+// 发起一条到后端的连接
+void connect_backend(BackendConn *conn) {
+    struct sockaddr_in sin;
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(conn->service->backend->port);
+    evutil_inet_pton(AF_INET, BACKEND_ADDR, &sin.sin_addr);
+    conn->bev = bufferevent_socket_new(gateway->base, -1, BEV_OPT_CLOSE_ON_FREE);
+    bufferevent_setcb(conn->bev, backend_read_cb, nullptr, backend_event_cb, conn);
+    bufferevent_enable(conn->bev, EV_READ | EV_WRITE);
+    if (bufferevent_socket_connect(conn->bev, reinterpret_cast<struct sockaddr *>(&sin), sizeof(sin)) < 0) {
+        // 立即失败时 bufferevent 不会再回调，这里自己安排重连
+        bufferevent_free(conn->bev);
+        conn->bev = nullptr;
+        struct timeval delay = {RECONNECT_SECONDS, 0};
+        event_add(conn->retry, &delay);
+    }
+}
+
+// 建立当前线程的网关状态，为每个后端建立连接池（每个工作线程各有一套）
+void start_pools(struct event_base *base) {
+    gateway = new Gateway();
+    gateway->base = base;
+    for (int i = 0; i < BACKEND_COUNT; i++) {
+        Service *service = &gateway->services[i];
+        service->backend = &backends[i];
+        for (int j = 0; j < POOL_SIZE; j++) {
+            auto *conn = new BackendConn();
+            conn->service = service;
+            conn->retry = evtimer_new(base, retry_cb, conn);
+            service->pool.push_back(conn);
+            connect_backend(conn);
+        }
+    }
+}
+
+// 按命令前缀找后端；只看行首几个字节
+Service *route(struct evbuffer *input, size_t line_len) {
+    char head[16];
+    size_t n = evbuffer_copyout(input, head, std::min(line_len, sizeof(head)));
+    for (const Route &r : routes) {
+        size_t len = strlen(r.prefix);
+        if (n >= len && memcmp(head, r.prefix, len) == 0) {
+            return &gateway->services[r.backend];
+        }
+    }
+    return nullptr;
+}
+
+// 读取回调函数，当有数据可读时调用：逐行取出请求并转发
 void read_cb(struct bufferevent *bev, void *ctx) {
-    // 获取输入和输出缓冲区
+    auto *client = static_cast<Client *>(ctx);
     struct evbuffer *input = bufferevent_get_input(bev);
-    struct evbuffer *output = bufferevent_get_output(bev);
-    evbuffer_add_buffer(output, input); // 将输入缓冲区的数据转移到输出缓冲区
+    while (true) {
+        auto start = std::chrono::steady_clock::now(); // 请求开始处理的时间
+        size_t eol_len = 0;
+        struct evbuffer_ptr eol = evbuffer_search_eol(input, nullptr, &eol_len, EVBUFFER_EOL_CRLF);
+        if (eol.pos < 0) {
+            if (evbuffer_get_length(input) > framing::MAX_LINE) {
+                // 一行长得离谱：不是正常客户端，断开
+                service_metrics.errors.inc();
+                close_client(client);
+            }
+            return;
+        }
+        size_t line_len = eol.pos;
+        if (line_len == 0) {
+            evbuffer_drain(input, eol_len); // 空行
+            continue;
+        }
+
+        Pending pending{client->id, client->next_seq++};
+        client->replies.push_back(Reply{evbuffer_new(), false});
+        Service *service = route(input, line_len);
+        if (!service) {
+            evbuffer_drain(input, line_len + eol_len);
+            service_metrics.errors.inc();
+            fail_request(pending, REPLY_UNKNOWN);
+        } else {
+            // 请求行连同统一的 "\n" 结尾移进一个独立的 evbuffer（只移动数据块）
+            struct evbuffer *line = evbuffer_new();
+            evbuffer_remove_buffer(input, line, line_len);
+            evbuffer_drain(input, eol_len);
+            evbuffer_add(line, "\n", 1);
+            BackendConn *conn = pick_conn(service);
+            if (conn && service->waiting.empty()) {
+                send_request(conn, pending, line);
+                evbuffer_free(line);
+            } else if (!reachable(service)) {
+                evbuffer_free(line);
+                service->backend->failed.inc();
+                fail_request(pending, REPLY_UNAVAILABLE);
+            } else if (service->waiting.size() < MAX_WAITING) {
+                service->waiting.push_back(Waiting{pending, line});
+            } else {
+                evbuffer_free(line);
+                service->backend->failed.inc();
+                fail_request(pending, REPLY_BUSY);
+            }
+        }
+        service_metrics.request_done(line_len + eol_len, start);
+    }
+}
+
+// 写回调：输出缓冲区写空时调用；半关闭的客户端等所有回复到齐、写完后再关
+void write_cb(struct bufferevent *bev, void *ctx) {
+    auto *client = static_cast<Client *>(ctx);
+    if (client->closing && client->replies.empty()) {
+        close_client(client);
+    }
 }
 
 // 事件回调函数，当连接发生错误或结束时调用
 void event_cb(struct bufferevent *bev, short events, void *ctx) {
+    auto *client = static_cast<Client *>(ctx);
     if (events & BEV_EVENT_ERROR) {
         std::cerr << "Error from bufferevent" << std::endl; // 如果发生错误，输出错误信息
+        service_metrics.errors.inc();
+        close_client(client);
+        return;
     }
-    if (events & (BEV_EVENT_EOF | BEV_EVENT_ERROR)) {
-        bufferevent_free(bev); // 如果连接结束或发生错误，释放bufferevent
+    if (events & BEV_EVENT_EOF) {
+        // 客户端只是关了写端：还在后端的请求的回复照样要写给它
+        if (client->replies.empty() && evbuffer_get_length(bufferevent_get_output(bev)) == 0) {
+            close_client(client);
+            return;
+        }
+        client->closing = true;
+        bufferevent_disable(bev, EV_READ); // 不再读；回复写完后由 write_cb 关闭
     }
 }
 
-// 接受连接回调函数，当有新的客户端连接时调用
-void accept_conn_cb(struct evconnlistener *listener, evutil_socket_t fd, struct sockaddr *addr, int len, void *ctx) {
-    struct event_base *base = evconnlistener_get_base(listener); // 获取事件基础
+// 在 base 上为新连接建立客户端（单线程时在主线程，否则在分到的工作线程上）
+void start_connection(struct event_base *base, evutil_socket_t fd, void *ctx) {
     struct bufferevent *bev = bufferevent_socket_new(base, fd, BEV_OPT_CLOSE_ON_FREE); // 为新连接创建一个bufferevent
-    bufferevent_setcb(bev, read_cb, nullptr, event_cb, nullptr); // 设置bufferevent的回调函数
+    auto *client = new Client();
+    client->id = gateway->next_client_id++;
+    client->bev = bev;
+    gateway->clients[client->id] = client;
+    bufferevent_setcb(bev, read_cb, write_cb, event_cb, client); // 设置bufferevent的回调函数
+    service_metrics.connection_opened(bev); // 统计连接并跟踪输出队列
     bufferevent_enable(bev, EV_READ | EV_WRITE); // 启用读写事件
 }
 
+// 接受连接回调函数，当有新的客户端连接时调用
+void accept_conn_cb(struct evconnlistener *listener, evutil_socket_t fd, struct sockaddr *addr, int len, void *ctx) {
+    if (pool.running()) {
+        pool.dispatch(fd); // 交给连接最少的工作线程
+        return;
+    }
+    start_connection(evconnlistener_get_base(listener), fd, nullptr);
+}
+
 // 接受错误回调函数，当监听器发生错误时调用
 void accept_error_cb(struct evconnlistener *listener, void *ctx) {
     struct event_base *base = evconnlistener_get_base(listener); // 获取事件基础
@@ -41,7 +447,8 @@ void accept_error_cb(struct evconnlistener *listener, void *ctx) {
     event_base_loopexit(base, nullptr); // 退出事件循环
 }
 
-int main() {
+int main(int argc, char **argv) {
+    int worker_count = workers::parse_workers(argc, argv); // --workers N
     struct event_base *base; // 定义事件基础
     struct evconnlistener *listener; // 定义连接监听器
     struct sockaddr_in sin; // 定义地址结构体
@@ -67,8 +474,18 @@ int main() {
         return 1;
     }
     evconnlistener_set_error_cb(listener, accept_error_cb); // 设置监听器的错误回调函数
+    metrics::serve(base, METRICS_PORT); // 在同一个事件循环里提供 /metrics
+    // 预先连好各个后端，连不上的会定时重试；有工作线程时由每个工作线程各自连
+    if (worker_count > 0) {
+        if (!pool.start(worker_count, start_connection, nullptr, start_pools)) {
+            return 1;
+        }
+    } else {
+        start_pools(base);
+    }
 
     event_base_dispatch(base); // 进入事件循环
+    pool.stop(); // 等工作线程退出
     evconnlistener_free(listener); // 释放监听器
     event_base_free(base); // 释放事件基础
 
@@ -0,0 +1,270 @@
+#include <dirent.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "structlog.h"
+
+// 查询 log_server 写的结构化日志：按时间范围、服务、级别和字段过滤。
+// 文件用 mmap 打开，先看索引（或块头）里的时间和级别范围，再看块头的布隆过滤器，
+// 只解压可能有结果的块。
+//
+// 用法: log_query [--since T] [--until T] [--service S] [--level L]
+//                  [--field key=value]... [--grep 文本] [--stats] [文件...]
+// T 可以是 Unix 秒数、"YYYY-mm-dd HH:MM:SS"，或 30s/15m/1h/7d 这样的"多久以前"。
+// 没给文件时查当前目录下的 logs.clog 和它轮转出的 logs.clog.*。
+
+const char *DEFAULT_PATH = "logs.clog";
+
+struct Query {
+    uint64_t since = 0;             // 微秒，含
+    uint64_t until = UINT64_MAX;    // 微秒，含
+    uint8_t min_level = slog::DEBUG;
+    std::vector<std::pair<std::string, std::string>> fields; // service 也放在这里
+    std::string grep;               // 正文里要有的文本
+};
+
+struct Stats {
+    uint64_t files = 0;
+    uint64_t blocks = 0;
+    uint64_t blocks_read = 0;       // 真正解压了的块
+    uint64_t bytes_read = 0;        // 解压了的块的存放字节数
+    uint64_t records = 0;           // 解压出来的记录
+    uint64_t matched = 0;
+    uint64_t indexed_files = 0;
+};
+
+// 解析时间参数，返回微秒；格式不对返回 false
+bool parse_time(const char *text, uint64_t *us) {
+    char *end;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (end != text && *end == '\0') {
+        *us = value * 1000000; // Unix 秒数
+        return true;
+    }
+    if (end != text && end[1] == '\0') {
+        const char *units = "smhd";
+        const uint64_t seconds[] = {1, 60, 3600, 86400};
+        const char *unit = strchr(units, *end);
+        if (unit && *unit) {
+            *us = slog::now_us() - value * seconds[unit - units] * 1000000;
+            return true;
+        }
+    }
+    struct tm local;
+    memset(&local, 0, sizeof(local));
+    const char *rest = strptime(text, "%Y-%m-%d %H:%M:%S", &local);
+    if (!rest) {
+        rest = strptime(text, "%Y-%m-%dT%H:%M:%S", &local);
+    }
+    if (rest && *rest == '\0') {
+        local.tm_isdst = -1;
+        *us = static_cast<uint64_t>(mktime(&local)) * 1000000;
+        return true;
+    }
+    return false;
+}
+
+// 当前目录下的默认文件：轮转出的按名字（即时间）排序，正在写的放最后
+std::vector<std::string> default_files() {
+    std::vector<std::string> files;
+    std::string prefix = std::string(DEFAULT_PATH) + ".";
+    if (DIR *dir = opendir(".")) {
+        while (struct dirent *entry = readdir(dir)) {
+            if (strncmp(entry->d_name, prefix.c_str(), prefix.size()) == 0) {
+                files.push_back(entry->d_name);
+            }
+        }
+        closedir(dir);
+    }
+    std::sort(files.begin(), files.end());
+    if (access(DEFAULT_PATH, F_OK) == 0) {
+        files.push_back(DEFAULT_PATH);
+    }
+    return files;
+}
+
+bool matches(const slog::Record &record, const Query &query) {
+    if (record.ts < query.since || record.ts > query.until || record.level < query.min_level) {
+        return false;
+    }
+    for (auto &want : query.fields) {
+        bool found = false;
+        if (want.first == "service") {
+            found = *record.service == want.second;
+        }
+        for (size_t i = 0; !found && i < record.fields.size(); i++) {
+            const slog::Record::Field &field = record.fields[i];
+            found = *field.key == want.first && field.value_len == want.second.size() &&
+                    memcmp(field.value, want.second.data(), field.value_len) == 0;
+        }
+        if (!found) {
+            return false;
+        }
+    }
+    if (!query.grep.empty()) {
+        for (auto &field : record.fields) {
+            if (*field.key == "msg" &&
+                std::search(field.value, field.value + field.value_len, query.grep.begin(), query.grep.end()) !=
+                    field.value + field.value_len) {
+                return true;
+            }
+        }
+        return false;
+    }
+    return true;
+}
+
+// 按写入时的格式打印：时间 服务 级别 key=value... 正文
+void print(const slog::Record &record, std::string *out) {
+    char stamp[32];
+    time_t seconds = record.ts / 1000000;
+    struct tm local;
+    localtime_r(&seconds, &local);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &local);
+    char micros[8];
+    snprintf(micros, sizeof(micros), ".%06u", static_cast<unsigned>(record.ts % 1000000));
+    *out += stamp;
+    *out += micros;
+    *out += ' ';
+    *out += *record.service;
+    *out += ' ';
+    *out += record.level < 4 ? slog::LEVEL_NAMES[record.level] : "?";
+    const slog::Record::Field *msg = nullptr;
+    for (auto &field : record.fields) {
+        if (*field.key == "msg") {
+            msg = &field;
+            continue;
+        }
+        *out += ' ';
+        *out += *field.key;
+        *out += '=';
+        out->append(field.value, field.value_len);
+    }
+    if (msg) {
+        *out += ' ';
+        out->append(msg->value, msg->value_len);
+    }
+    *out += '\n';
+}
+
+// 查一个文件：时间、级别范围不相交的块连块头都不读，布隆过滤器排除的块不解压
+bool query_file(const std::string &path, const Query &query, const std::vector<uint64_t> &hashes, Stats *stats) {
+    slog::Reader reader;
+    if (!reader.open(path)) {
+        return false;
+    }
+    stats->files++;
+    bool indexed;
+    std::vector<slog::IndexEntry> blocks = reader.blocks(&indexed);
+    stats->indexed_files += indexed;
+    stats->blocks += blocks.size();
+    std::string out;
+    for (const slog::IndexEntry &entry : blocks) {
+        if (entry.max_ts < query.since || entry.min_ts > query.until || entry.max_level < query.min_level) {
+            continue;
+        }
+        slog::BlockHeader header;
+        if (!reader.header(entry.offset, &header)) {
+            std::cerr << path << ": 偏移 " << entry.offset << " 处的块头损坏" << std::endl;
+            continue;
+        }
+        bool possible = true;
+        for (uint64_t h : hashes) {
+            possible = possible && slog::bloom_may_contain(reader.bloom(entry.offset), header.bloom_len, h);
+        }
+        if (!possible) {
+            continue;
+        }
+        stats->blocks_read++;
+        stats->bytes_read += header.stored_len;
+        bool ok = reader.scan(entry.offset, header, [&](const slog::Record &record) {
+            stats->records++;
+            if (matches(record, query)) {
+                stats->matched++;
+                print(record, &out);
+            }
+        });
+        if (!ok) {
+            std::cerr << path << ": 偏移 " << entry.offset << " 处的块损坏，跳过" << std::endl;
+        }
+        if (out.size() >= 64 << 10) {
+            fwrite(out.data(), 1, out.size(), stdout);
+            out.clear();
+        }
+    }
+    fwrite(out.data(), 1, out.size(), stdout);
+    return true;
+}
+
+void usage() {
+    std::cerr << "用法: log_query [--since T] [--until T] [--service S] [--level debug|info|warn|error]\n"
+                 "                 [--field key=value]... [--grep 文本] [--stats] [文件...]\n"
+                 "T: Unix 秒数、\"YYYY-mm-dd HH:MM:SS\"，或 30s/15m/1h/7d（多久以前）" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    Query query;
+    bool show_stats = false;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if ((arg == "--since" || arg == "--until") && has_value) {
+            if (!parse_time(argv[++i], arg == "--since" ? &query.since : &query.until)) {
+                std::cerr << "无法解析时间: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--service" && has_value) {
+            query.fields.emplace_back("service", argv[++i]);
+        } else if (arg == "--level" && has_value) {
+            i++;
+            if (!slog::parse_level(argv[i], strlen(argv[i]), &query.min_level)) {
+                usage();
+                return 1;
+            }
+        } else if (arg == "--field" && has_value) {
+            const char *field = argv[++i];
+            const char *eq = strchr(field, '=');
+            if (!eq || eq == field) {
+                usage();
+                return 1;
+            }
+            query.fields.emplace_back(std::string(field, eq - field), eq + 1);
+        } else if (arg == "--grep" && has_value) {
+            query.grep = argv[++i];
+        } else if (arg == "--stats") {
+            show_stats = true;
+        } else if (arg.compare(0, 2, "--") == 0) {
+            usage();
+            return 1;
+        } else {
+            files.push_back(arg);
+        }
+    }
+    if (files.empty()) {
+        files = default_files();
+    }
+
+    std::vector<uint64_t> hashes; // 字段条件在布隆过滤器里的哈希
+    for (auto &field : query.fields) {
+        if (field.first == "msg") {
+            continue; // 正文不进过滤器
+        }
+        hashes.push_back(slog::field_hash(field.first.data(), field.first.size(), field.second.data(), field.second.size()));
+    }
+    Stats stats;
+    bool ok = true;
+    for (auto &path : files) {
+        ok = query_file(path, query, hashes, &stats) && ok;
+    }
+    if (show_stats) {
+        std::cerr << "文件 " << stats.files << "（有索引 " << stats.indexed_files << "），块 " << stats.blocks
+                  << "，解压 " << stats.blocks_read << " 块 / " << stats.bytes_read << " 字节，记录 "
+                  << stats.records << "，命中 " << stats.matched << std::endl;
+    }
+    return ok ? 0 : 1;
+}
@@ -1,52 +1,189 @@
 #include <event2/event.h>
 #include <event2/bufferevent.h>
 #include <event2/listener.h>
+#include <sys/eventfd.h>
+#include <signal.h>
+#include <unistd.h>
 #include <iostream>
 #include <cstring>
-#include <fstream>
+#include <deque>
+#include <unordered_set>
+#include <algorithm>
 #include <event2/buffer.h> // 添加这个头文件，用于缓冲区操作
+#include "framing.h"
+#include "log_writer.h"
+#include "metrics.h"
+#include "structlog.h"
+#include "workers.h"
 
 #define LISTEN_PORT 5003 // 定义监听端口为5003
+#define METRICS_PORT 6003 // /metrics 监听端口
 
-// 读取回调函数，当有数据可读时调用
+metrics::ServiceMetrics service_metrics("log_server"); // 本服务的指标
+workers::Pool pool; // --workers N 时的工作线程池
+logwriter::GroupWriter log_writer; // 分组提交的日志写入器，所有事件循环共用
+slog::BlockFormat block_format; // 结构化日志的文件格式，只在写线程上使用
+bool structured = true; // 写结构化的二进制日志（logs.clog），--format text 时写纯文本 logs.txt
+
+const char *REPLY_LOGGED = "{\"status\":\"logged\"}\n";
+const char *REPLY_UNKNOWN = "{\"status\":\"unknown\"}\n";
+const uint64_t UNASSIGNED = UINT64_MAX; // 批次号还没拿到
+
+// 一个还没发出的回复：batch 为 0 的随时可以发，否则等这个批次落盘
+struct Ack {
+    uint64_t batch;
+    const char *reply;
+};
+
+// 客户端连接：回复按请求顺序排队，前面的日志没落盘时后面的回复也等着
+struct Connection {
+    struct bufferevent *bev;
+    std::deque<Ack> acks;
+    bool closing = false; // 客户端已经关了写端，回复都发完再关
+};
+
+// 每个事件循环一份：接收落盘通知的 eventfd，和有回复在等落盘的连接
+struct Loop {
+    int wake_fd;
+    struct event *wake_event;
+    std::unordered_set<Connection *> waiting;
+};
+
+thread_local Loop *loop = nullptr; // 当前线程的事件循环状态
+
+// 把已经可以发的回复按顺序写出；全部发完返回 true
+bool flush_acks(Connection *conn, uint64_t durable) {
+    struct evbuffer *output = bufferevent_get_output(conn->bev);
+    while (!conn->acks.empty() && conn->acks.front().batch <= durable) {
+        evbuffer_add(output, conn->acks.front().reply, strlen(conn->acks.front().reply));
+        conn->acks.pop_front();
+    }
+    return conn->acks.empty();
+}
+
+// 写线程通知有批次落盘：给等着的连接发回复
+void durable_cb(evutil_socket_t fd, short events, void *ctx) {
+    uint64_t count;
+    ssize_t n = read(fd, &count, sizeof(count));
+    (void)n;
+    uint64_t durable = log_writer.durable();
+    for (auto it = loop->waiting.begin(); it != loop->waiting.end();) {
+        if (flush_acks(*it, durable)) {
+            it = loop->waiting.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// 建立当前线程的事件循环状态，向写入器登记落盘通知（每个工作线程各一份）
+void start_loop(struct event_base *base) {
+    loop = new Loop();
+    loop->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    loop->wake_event = event_new(base, loop->wake_fd, EV_READ | EV_PERSIST, durable_cb, nullptr);
+    event_add(loop->wake_event, nullptr);
+    log_writer.add_listener(loop->wake_fd);
+}
+
+// 关闭连接并释放bufferevent；没来得及确认的日志照样会写入
+void close_connection(Connection *conn) {
+    loop->waiting.erase(conn);
+    service_metrics.connection_closed(conn->bev);
+    workers::connection_closed();
+    bufferevent_free(conn->bev);
+    delete conn;
+}
+
+// 读取回调函数，当有数据可读时调用：这次读到的所有日志行合成一段交给写入器，
+// 它们的确认等所在批次落盘后才发出。结构化日志的行开头可以带 key=value 字段，
+// 如 "/log service=chat level=warn user=alice 发送失败"
 void read_cb(struct bufferevent *bev, void *ctx) {
-    // 获取输入和输出缓冲区
+    auto *conn = static_cast<Connection *>(ctx);
     struct evbuffer *input = bufferevent_get_input(bev);
-    struct evbuffer *output = bufferevent_get_output(bev);
-    char buf[1024];
-    int n = evbuffer_remove(input, buf, sizeof(buf) - 1); // 从输入缓冲区读取数据
-    buf[n] = '\0'; // 确保字符串以空字符结尾
-
-    std::string request(buf);
-    if (request.find("/log") != std::string::npos) {
-        // 如果请求包含"/log"，提取日志信息并写入文件
-        std::string message = request.substr(5);
-        std::ofstream log_file("logs.txt", std::ios_base::app); // 以追加模式打开日志文件
-        log_file << message << std::endl;
-        evbuffer_add(output, "{\"status\":\"logged\"}", 19); // 返回日志记录成功的响应
-    } else {
-        evbuffer_add(output, "{\"status\":\"unknown\"}", 20); // 返回未知请求的响应
+    std::string lines; // 本次的日志行（各带 '\n'），或编码好的待写记录
+    size_t first = conn->acks.size();
+    bool ok = framing::for_each_line(input, [conn, &lines](const char *line, size_t len, size_t bytes) {
+        auto start = std::chrono::steady_clock::now(); // 请求开始处理的时间
+        if (framing::starts_with(line, len, "/log")) {
+            // 如果请求以"/log"开头，提取日志信息
+            size_t skip = std::min<size_t>(5, len);
+            if (structured) {
+                slog::encode_line(line + skip, len - skip, slog::now_us(), &lines);
+            } else {
+                lines.append(line + skip, len - skip);
+                lines += '\n';
+            }
+            conn->acks.push_back(Ack{UNASSIGNED, REPLY_LOGGED});
+        } else {
+            conn->acks.push_back(Ack{0, REPLY_UNKNOWN}); // 未知请求：不用等落盘，但不能插到前面的确认之前
+            service_metrics.errors.inc();
+        }
+        service_metrics.request_done(bytes, start);
+    });
+    if (!lines.empty()) {
+        uint64_t batch = log_writer.append(lines.data(), lines.size());
+        for (size_t i = first; i < conn->acks.size(); i++) {
+            if (conn->acks[i].batch == UNASSIGNED) {
+                conn->acks[i].batch = batch;
+            }
+        }
+    }
+    if (!flush_acks(conn, log_writer.durable())) {
+        loop->waiting.insert(conn);
+    }
+    if (!ok) {
+        service_metrics.errors.inc(); // 一行长得离谱：不是正常客户端，断开
+        close_connection(conn);
+    }
+}
+
+// 写回调：输出缓冲区写空时调用；半关闭的连接等所有确认都发出去后再关
+void write_cb(struct bufferevent *bev, void *ctx) {
+    auto *conn = static_cast<Connection *>(ctx);
+    if (conn->closing && conn->acks.empty()) {
+        close_connection(conn);
     }
 }
 
 // 事件回调函数，当连接发生错误或结束时调用
 void event_cb(struct bufferevent *bev, short events, void *ctx) {
+    auto *conn = static_cast<Connection *>(ctx);
     if (events & BEV_EVENT_ERROR) {
         std::cerr << "Error from bufferevent" << std::endl; // 如果发生错误，输出错误信息
+        service_metrics.errors.inc();
+        close_connection(conn);
+        return;
     }
-    if (events & (BEV_EVENT_EOF | BEV_EVENT_ERROR)) {
-        bufferevent_free(bev); // 如果连接结束或发生错误，释放bufferevent
+    if (events & BEV_EVENT_EOF) {
+        // 客户端只是关了写端（如 nc -N）：还在等落盘的确认照样要发给它
+        if (conn->acks.empty() && evbuffer_get_length(bufferevent_get_output(bev)) == 0) {
+            close_connection(conn);
+            return;
+        }
+        conn->closing = true;
+        bufferevent_disable(bev, EV_READ); // 不再读；剩下的确认发完后由 write_cb 关闭
     }
 }
 
-// 接受连接回调函数，当有新的客户端连接时调用
-void accept_conn_cb(struct evconnlistener *listener, evutil_socket_t fd, struct sockaddr *addr, int len, void *ctx) {
-    struct event_base *base = evconnlistener_get_base(listener); // 获取事件基础
+// 在 base 上为新连接建立 bufferevent（单线程时在主线程，否则在分到的工作线程上）
+void start_connection(struct event_base *base, evutil_socket_t fd, void *ctx) {
     struct bufferevent *bev = bufferevent_socket_new(base, fd, BEV_OPT_CLOSE_ON_FREE); // 为新连接创建一个bufferevent
-    bufferevent_setcb(bev, read_cb, nullptr, event_cb, nullptr); // 设置bufferevent的回调函数
+    auto *conn = new Connection();
+    conn->bev = bev;
+    bufferevent_setcb(bev, read_cb, write_cb, event_cb, conn); // 设置bufferevent的回调函数
+    service_metrics.connection_opened(bev); // 统计连接并跟踪输出队列
     bufferevent_enable(bev, EV_READ | EV_WRITE); // 启用读写事件
 }
 
+// 接受连接回调函数，当有新的客户端连接时调用
+void accept_conn_cb(struct evconnlistener *listener, evutil_socket_t fd, struct sockaddr *addr, int len, void *ctx) {
+    if (pool.running()) {
+        pool.dispatch(fd); // 交给连接最少的工作线程
+        return;
+    }
+    start_connection(evconnlistener_get_base(listener), fd, nullptr);
+}
+
 // 接受错误回调函数，当监听器发生错误时调用
 void accept_error_cb(struct evconnlistener *listener, void *ctx) {
     struct event_base *base = evconnlistener_get_base(listener); // 获取事件基础
@@ -55,7 +192,38 @@ void accept_error_cb(struct evconnlistener *listener, void *ctx) {
     event_base_loopexit(base, nullptr); // 退出事件循环
 }
 
-int main() {
+// SIGINT/SIGTERM：退出事件循环，main 随后写完剩下的批次并给文件写上索引
+void signal_cb(evutil_socket_t sig, short events, void *user_data) {
+    struct event_base *base = static_cast<struct event_base *>(user_data);
+    std::cout << "捕获到信号 " << sig << "，写完日志后退出。" << std::endl;
+    event_base_loopexit(base, nullptr);
+}
+
+int main(int argc, char **argv) {
+    int worker_count = workers::parse_workers(argc, argv); // --workers N
+    // --fsync none|data|full：每批写出后的刷盘方式，默认 data（fdatasync）
+    // --format binary|text：结构化的二进制日志（默认，用 log_query 查询）或纯文本
+    logwriter::Options options;
+    for (int i = 1; i < argc; i++) {
+        bool bad = false;
+        if (strcmp(argv[i], "--fsync") == 0) {
+            bad = i + 1 == argc || !logwriter::parse_sync(argv[++i], &options.sync);
+        } else if (strcmp(argv[i], "--format") == 0) {
+            bad = i + 1 == argc || (strcmp(argv[i + 1], "binary") != 0 && strcmp(argv[i + 1], "text") != 0);
+            structured = !bad && strcmp(argv[++i], "binary") == 0;
+        }
+        if (bad) {
+            std::cerr << "用法: log_server [--workers N] [--fsync none|data|full] [--format binary|text]" << std::endl;
+            return 1;
+        }
+    }
+    if (structured) {
+        options.path = "logs.clog";
+        options.format = &block_format;
+    }
+    if (!log_writer.start(options)) {
+        return 1;
+    }
     struct event_base *base; // 定义事件基础
     struct evconnlistener *listener; // 定义连接监听器
     struct sockaddr_in sin; // 定义地址结构体
@@ -81,8 +249,27 @@ int main() {
         return 1;
     }
     evconnlistener_set_error_cb(listener, accept_error_cb); // 设置监听器的错误回调函数
+    metrics::serve(base, METRICS_PORT); // 在同一个事件循环里提供 /metrics
+    struct event *sigint_event = evsignal_new(base, SIGINT, signal_cb, base);
+    struct event *sigterm_event = evsignal_new(base, SIGTERM, signal_cb, base);
+    if (!sigint_event || !sigterm_event || event_add(sigint_event, nullptr) < 0 || event_add(sigterm_event, nullptr) < 0) {
+        std::cerr << "无法创建或添加信号事件!" << std::endl;
+        return 1;
+    }
+    // 每个事件循环都要接收落盘通知；有工作线程时连接都在工作线程上
+    if (worker_count > 0) {
+        if (!pool.start(worker_count, start_connection, nullptr, start_loop)) {
+            return 1;
+        }
+    } else {
+        start_loop(base);
+    }
 
     event_base_dispatch(base); // 进入事件循环
+    pool.stop(); // 等工作线程退出
+    log_writer.stop(); // 写完剩下的批次
+    event_free(sigint_event);
+    event_free(sigterm_event);
     evconnlistener_free(listener); // 释放监听器
     event_base_free(base); // 释放事件基础
 
@@ -0,0 +1,317 @@
+#ifndef LOG_WRITER_H
+#define LOG_WRITER_H
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 分组提交的日志写入器（仅头文件）。各事件循环只把行追加进内存里的当前批次，
+// 一个专门的写线程每隔 flush_ms 毫秒、或批次攒够 flush_bytes 字节时，把整批
+// 一次 write 出去并按策略刷盘，然后公布"已落盘的批次号"并唤醒登记过的事件循环。
+// 请求方拿着 append() 返回的批次号，等 durable() 追上它再回复，确认就只在数据
+// 真正落盘之后发出；成千上万行共用一次 write 和一次 fsync。
+//
+// 文件超过 rotate_bytes 字节或打开超过 rotate_seconds 秒时轮转：改名为
+// <路径>.<时间戳> 并新开一个。
+//
+// 默认按原样写出追加的字节；给了 Options::format 时，每批先交给它编码（例如
+// structlog.h 的压缩块），文件开头和结尾（轮转、停止时）也由它补上。
+namespace logwriter {
+
+// 刷盘策略
+enum class Sync {
+    NONE,   // 只 write 到页缓存：进程崩溃不丢，掉电可能丢
+    DATA,   // 每批 fdatasync
+    FULL,   // 每批 fsync（连同文件元数据）
+};
+
+// 文件格式：只在写线程上调用（最后的 end_file 在 stop 里、写线程结束之后），可以放自己的状态
+class Format {
+public:
+    virtual ~Format() {}
+    virtual void begin_file(std::string *out) = 0;                      // 新文件的开头
+    virtual void encode(const std::string &batch, std::string *out) = 0; // 一批追加的数据编码成写进文件的字节
+    virtual void end_file(std::string *out) = 0;                        // 文件关闭前的结尾
+    virtual void repair(const std::string &path) = 0;                   // 上次没正常关闭留下的文件：截掉写了一半的尾巴、补上结尾
+};
+
+struct Options {
+    std::string path = "logs.txt";
+    Format *format = nullptr;                   // 为空时原样写出
+    int flush_ms = 5;                           // 最长攒批时间
+    size_t flush_bytes = 256 << 10;             // 攒够这么多字节立即提交
+    size_t max_pending_bytes = 64 << 20;        // 还没写出的字节上限，超过时 append 等写线程
+    Sync sync = Sync::DATA;
+    uint64_t rotate_bytes = 64 << 20;           // 单个文件的大小上限，0 表示不按大小轮转
+    int rotate_seconds = 3600;                  // 单个文件的时长上限，0 表示不按时间轮转
+};
+
+// 解析 --fsync 的取值
+inline bool parse_sync(const char *name, Sync *sync) {
+    if (strcmp(name, "none") == 0) {
+        *sync = Sync::NONE;
+    } else if (strcmp(name, "data") == 0) {
+        *sync = Sync::DATA;
+    } else if (strcmp(name, "full") == 0) {
+        *sync = Sync::FULL;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+class GroupWriter {
+public:
+    GroupWriter() {}
+
+    ~GroupWriter() {
+        stop();
+    }
+
+    GroupWriter(const GroupWriter &) = delete;
+    GroupWriter &operator=(const GroupWriter &) = delete;
+
+    // 打开日志文件并启动写线程；失败返回 false
+    bool start(const Options &options) {
+        this->options = options;
+        struct stat st;
+        if (options.format && stat(options.path.c_str(), &st) == 0 && st.st_size > 0) {
+            // 上次没正常关闭留下的文件没有结尾，不能接着写：补好后存档（失败就只好接着写）
+            options.format->repair(options.path);
+            rename_file();
+        }
+        if (!open_file()) {
+            return false;
+        }
+        writer = std::thread([this] { run(); });
+        return true;
+    }
+
+    // 登记一个 eventfd：每次有批次落盘就往里写 1
+    void add_listener(int fd) {
+        std::lock_guard<std::mutex> guard(mtx);
+        listeners.push_back(fd);
+    }
+
+    // 把若干完整的行（各自带 '\n'）追加进当前批次，返回批次号；
+    // durable() >= 这个批次号时它们已经落盘
+    uint64_t append(const char *data, size_t len) {
+        std::unique_lock<std::mutex> guard(mtx);
+        // 写线程跟不上时在这里等，不让内存无限增长
+        space.wait(guard, [this] { return filling.size() + writing_bytes < options.max_pending_bytes || stopping; });
+        bool first = filling.empty();
+        filling.append(data, len);
+        // 批次的第一段数据开始计时，攒够了就不必再等
+        if (first || filling.size() >= options.flush_bytes) {
+            ready.notify_one();
+        }
+        return batch;
+    }
+
+    // 已经落盘的最新批次号
+    uint64_t durable() const {
+        return committed.load(std::memory_order_acquire);
+    }
+
+    // 写完剩下的批次后停止写线程
+    void stop() {
+        {
+            std::lock_guard<std::mutex> guard(mtx);
+            if (!writer.joinable()) {
+                return;
+            }
+            stopping = true;
+        }
+        ready.notify_one();
+        space.notify_all();
+        writer.join();
+        finish_file();
+        close(fd);
+        fd = -1;
+    }
+
+    // 写线程的累计数据，供指标使用
+    uint64_t commits() const {
+        return commit_count.load(std::memory_order_relaxed);
+    }
+
+    uint64_t bytes_written() const {
+        return written_bytes.load(std::memory_order_relaxed);
+    }
+
+private:
+    Options options;
+    std::mutex mtx;                     // 保护 filling、batch、listeners 和 stopping
+    std::condition_variable ready;      // 通知写线程：攒够了或要停止
+    std::condition_variable space;      // 通知追加方：写线程腾出了空间
+    std::string filling;                // 正在攒的批次
+    uint64_t batch = 1;                 // filling 的批次号
+    size_t writing_bytes = 0;           // 写线程手里还没写完的字节
+    bool stopping = false;
+    std::vector<int> listeners;
+    std::atomic<uint64_t> committed{0};
+    std::atomic<uint64_t> commit_count{0};
+    std::atomic<uint64_t> written_bytes{0};
+    std::thread writer;
+
+    // 以下只由写线程使用（start 之前由调用线程）
+    int fd = -1;
+    uint64_t file_bytes = 0;
+    time_t opened_at = 0;
+
+    bool open_file() {
+        fd = ::open(options.path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd == -1) {
+            std::cerr << "无法打开日志文件 " << options.path << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        struct stat st;
+        file_bytes = fstat(fd, &st) == 0 ? st.st_size : 0;
+        opened_at = time(nullptr);
+        if (options.format && file_bytes == 0) {
+            std::string header;
+            options.format->begin_file(&header);
+            commit(header);
+        }
+        return true;
+    }
+
+    // 给当前文件写上格式要求的结尾
+    void finish_file() {
+        if (options.format) {
+            std::string footer;
+            options.format->end_file(&footer);
+            commit(footer);
+        }
+    }
+
+    // 当前文件太大或太旧就改名存档，换一个新文件
+    void maybe_rotate() {
+        bool too_big = options.rotate_bytes > 0 && file_bytes >= options.rotate_bytes;
+        bool too_old = options.rotate_seconds > 0 && file_bytes > 0 &&
+                       time(nullptr) - opened_at >= options.rotate_seconds;
+        if (!too_big && !too_old) {
+            return;
+        }
+        finish_file();
+        if (!rename_file()) {
+            opened_at = time(nullptr); // 过一个周期再试，不要每批都试
+            return;
+        }
+        int old = fd;
+        if (open_file()) {
+            close(old);
+        } else {
+            fd = old; // 新文件开不了就继续写改了名的旧文件
+        }
+    }
+
+    // 把当前文件改名为 <路径>.<时间戳> 存档
+    bool rename_file() {
+        char stamp[32];
+        time_t now = time(nullptr);
+        struct tm local;
+        localtime_r(&now, &local);
+        strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+        std::string archive = options.path + "." + stamp;
+        for (int i = 1; access(archive.c_str(), F_OK) == 0; i++) {
+            archive = options.path + "." + stamp + "." + std::to_string(i); // 同一秒内轮转多次
+        }
+        if (rename(options.path.c_str(), archive.c_str()) == -1) {
+            std::cerr << "无法轮转日志文件 " << options.path << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // 把一批数据完整写出并按策略刷盘；出错时稍后重试，不确认没落盘的数据
+    void commit(const std::string &data) {
+        if (data.empty()) {
+            return;
+        }
+        size_t done = 0;
+        while (done < data.size()) {
+            ssize_t n = write(fd, data.data() + done, data.size() - done);
+            if (n < 0) {
+                if (errno != EINTR) {
+                    std::cerr << "写日志失败: " << strerror(errno) << "，稍后重试" << std::endl;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                }
+                continue;
+            }
+            done += n;
+        }
+        while (options.sync != Sync::NONE && (options.sync == Sync::FULL ? fsync(fd) : fdatasync(fd)) == -1) {
+            std::cerr << "日志刷盘失败: " << strerror(errno) << "，稍后重试" << std::endl;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        file_bytes += data.size();
+    }
+
+    // 写线程：取走当前批次，写出、刷盘、公布，再看要不要轮转
+    void run() {
+        std::string batch_data; // 追加进来的数据
+        std::string writing;    // 真正写进文件的字节
+        for (;;) {
+            uint64_t id;
+            std::vector<int> notify;
+            {
+                std::unique_lock<std::mutex> guard(mtx);
+                // 空闲时一直睡；有数据后最多再等 flush_ms，让后来的行搭同一批
+                ready.wait(guard, [this] { return !filling.empty() || stopping; });
+                ready.wait_for(guard, std::chrono::milliseconds(options.flush_ms), [this] {
+                    return filling.size() >= options.flush_bytes || stopping;
+                });
+                if (filling.empty()) {
+                    if (stopping) {
+                        return;
+                    }
+                    continue;
+                }
+                batch_data.clear();
+                batch_data.swap(filling);
+                writing_bytes = batch_data.size();
+                id = batch++;
+                notify = listeners;
+            }
+            if (options.format) {
+                writing.clear();
+                options.format->encode(batch_data, &writing);
+            } else {
+                writing.swap(batch_data);
+            }
+            commit(writing);
+            commit_count.fetch_add(1, std::memory_order_relaxed);
+            written_bytes.fetch_add(writing.size(), std::memory_order_relaxed);
+            committed.store(id, std::memory_order_release);
+            {
+                std::lock_guard<std::mutex> guard(mtx);
+                writing_bytes = 0;
+            }
+            space.notify_all();
+            for (int listener : notify) {
+                uint64_t one = 1;
+                ssize_t n = ::write(listener, &one, sizeof(one));
+                (void)n;
+            }
+            maybe_rotate();
+        }
+    }
+};
+
+} // namespace logwriter
+
+#endif // LOG_WRITER_H
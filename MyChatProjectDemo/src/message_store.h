@@ -0,0 +1,464 @@
+#ifndef MESSAGE_STORE_H
+#define MESSAGE_STORE_H
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "checksum.h"
+
+// 只追加的消息日志（仅头文件）。消息按顺序编号（从 1 开始），写进目录下一串
+// 固定大小的段文件，文件名是段内第一条消息的编号。段用 mmap 映射：追加就是
+// 往映射里拷贝，读取直接读页缓存，进程内不再保存消息副本。
+//
+// 记录格式（8 字节对齐）：长度 u32 | CRC32 u32 | 编号 u64 | 内容。长度最后
+// 写入，长度为 0 表示段的有效数据到此为止（新段文件全是 0），所以不存空消息。
+// 启动时逐条校验每个段，遇到长度越界、CRC 不符或编号不连续就停下；最后一个段
+// 在那之后的字节被清零，即截掉崩溃时写了一半的尾巴。
+//
+// 内存里只有每个段的稀疏索引（每 INDEX_INTERVAL 条记一个偏移），段数超过上限时
+// 删除最旧的段，所以常驻内存和磁盘占用都有上限。
+//
+// 可以被多个线程同时追加和读取。追加不加锁：活动段的"已预留条数和字节数"放在
+// 一个 64 位字里，一次 CAS 同时得到编号和偏移，然后各自拷贝、最后发布长度。
+// 读者只看到连续发布了的前缀，碰到还没发布的记录就停下。只有换段时拿一把锁。
+// 段文件被删除后映射还留着，直到它的槽位被新段复用，且没有读者钉住它才解除。
+namespace store {
+
+const size_t SEGMENT_SIZE = 4 << 20;    // 每个段文件的大小
+const size_t MAX_SEGMENTS = 64;         // 最多保留的段数，更旧的被删除
+const uint32_t INDEX_INTERVAL = 64;     // 稀疏索引的间隔（条）
+
+// 记录头
+struct RecordHeader {
+    uint32_t length;    // 内容字节数，0 表示没有记录
+    uint32_t crc;       // 编号和内容的 CRC32
+    uint64_t seq;       // 消息编号
+};
+
+// 一条记录占用的字节数（含头和对齐）
+inline size_t record_size(size_t length) {
+    return (sizeof(RecordHeader) + length + 7) & ~size_t(7);
+}
+
+class MessageLog {
+public:
+    MessageLog() {}
+
+    ~MessageLog() {
+        for (Segment &segment : slots) {
+            if (segment.data) {
+                munmap(segment.data, SEGMENT_SIZE);
+            }
+        }
+    }
+
+    MessageLog(const MessageLog &) = delete;
+    MessageLog &operator=(const MessageLog &) = delete;
+
+    // 打开（必要时创建）目录 dir 下的日志，恢复已有的段；失败返回 false。
+    // 必须在其他线程开始使用之前调用
+    bool open(const std::string &dir) {
+        this->dir = dir;
+        if (mkdir(dir.c_str(), 0755) == -1 && errno != EEXIST) {
+            std::cerr << "无法创建消息目录 " << dir << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        std::vector<uint64_t> bases;
+        if (DIR *d = opendir(dir.c_str())) {
+            while (dirent *entry = readdir(d)) {
+                unsigned long long base;
+                char tail;
+                if (sscanf(entry->d_name, "%llu.seg%c", &base, &tail) == 1) {
+                    bases.push_back(base);
+                }
+            }
+            closedir(d);
+        }
+        std::sort(bases.begin(), bases.end());
+        uint64_t next = 1;
+        bool loaded = false;
+        for (uint64_t base : bases) {
+            // 编号不接续的段（前面的段被截断过）从这里起作废
+            if (loaded && base != next) {
+                std::cerr << "丢弃不连续的段 " << segment_path(base) << std::endl;
+                unlink(segment_path(base).c_str());
+                continue;
+            }
+            if (!load(base, loaded)) {
+                return false;
+            }
+            loaded = true;
+            next = end_seq(slot(last));
+        }
+        if (!loaded) {
+            return install(0, 1);
+        }
+        truncate_tail(slot(last));
+        return true;
+    }
+
+    // 追加一条消息，返回它的编号；失败返回 0
+    uint64_t append(const char *data, size_t len) {
+        size_t size = record_size(len);
+        if (len == 0 || size > SEGMENT_SIZE) {
+            return 0;
+        }
+        for (;;) {
+            uint64_t number = last.load(std::memory_order_acquire);
+            Segment &segment = slot(number);
+            uint64_t state = segment.state.load(std::memory_order_acquire);
+            while (!(state & SEALED)) {
+                uint64_t end = state_end(state);
+                uint64_t count = state_count(state);
+                // 放不下就封住这个段，之后的追加都去换段
+                uint64_t wanted = end + size > SEGMENT_SIZE ? state | SEALED : state + (uint64_t(1) << 32) + size;
+                if (!segment.state.compare_exchange_weak(state, wanted, std::memory_order_acq_rel)) {
+                    continue; // state 已更新为最新值
+                }
+                if (wanted & SEALED) {
+                    break;
+                }
+                uint64_t seq = segment.base + count;
+                write_record(segment, end, count, seq, data, len);
+                return seq;
+            }
+            if (!roll(number)) {
+                return 0;
+            }
+        }
+    }
+
+    // 依次访问编号 >= from 的消息，最多 limit 条；fn(seq, data, len) 返回
+    // false 时在这条之前停止。返回接受的条数。只访问已经连续发布的消息；
+    // data 指向映射，fn 返回前一直有效
+    template <typename F>
+    size_t scan(uint64_t from, size_t limit, F fn) {
+        size_t visited = 0;
+        uint64_t number = locate(from);
+        while (visited < limit && number <= last.load(std::memory_order_acquire)) {
+            if (!pin(number)) {
+                number = first.load(); // 段刚被删除，从现存最旧的段接着读
+                continue;
+            }
+            const Segment &segment = slot(number);
+            size_t offset = seek(segment, from);
+            bool finished = false; // 这个段已读完，可以进入下一个段
+            while (visited < limit) {
+                const RecordHeader *header = reinterpret_cast<const RecordHeader *>(segment.data + offset);
+                uint32_t length = offset + sizeof(RecordHeader) <= SEGMENT_SIZE
+                                      ? __atomic_load_n(&header->length, __ATOMIC_ACQUIRE) : 0;
+                if (length == 0) {
+                    // 段已封住且预留的记录都读过了才算读完；否则是还没发布的记录
+                    uint64_t state = segment.state.load(std::memory_order_acquire);
+                    finished = (state & SEALED) && offset >= state_end(state);
+                    break;
+                }
+                if (header->seq >= from) {
+                    if (!fn(header->seq, segment.data + offset + sizeof(RecordHeader), length)) {
+                        unpin(number);
+                        return visited;
+                    }
+                    visited++;
+                }
+                offset += record_size(length);
+            }
+            unpin(number);
+            if (!finished) {
+                break;
+            }
+            number++;
+        }
+        return visited;
+    }
+
+    // 把新写入的数据刷到磁盘（进程崩溃不需要它，页缓存里的数据不会丢；
+    // 这是为了机器掉电）
+    void sync() {
+        std::lock_guard<std::mutex> guard(roll_mtx); // 刷盘期间不换段
+        uint64_t number = last.load();
+        Segment &segment = slot(number);
+        if (number != synced_number) {
+            // 上一个段在换段时已经刷过
+            synced_number = number;
+            synced = 0;
+        }
+        uint64_t end = state_end(segment.state.load(std::memory_order_acquire));
+        if (end == synced) {
+            return;
+        }
+        uint64_t written = segment.written.load(std::memory_order_acquire);
+        size_t from = synced & ~size_t(4095);
+        msync(segment.data + from, end - from, MS_SYNC);
+        // 还有预留了没写完的记录时，下次从同一位置重刷
+        if (written == end) {
+            synced = end;
+        }
+    }
+
+    // 最旧的消息编号；没有消息时等于 next_seq()
+    uint64_t first_seq() const {
+        return slot(first.load()).base;
+    }
+
+    // 下一条消息会得到的编号
+    uint64_t next_seq() const {
+        return end_seq(slot(last.load(std::memory_order_acquire)));
+    }
+
+    // 保留的消息条数
+    uint64_t size() const {
+        return next_seq() - first_seq();
+    }
+
+    // 段文件占用的字节数
+    uint64_t disk_bytes() const {
+        return (last.load() - first.load() + 1) * SEGMENT_SIZE;
+    }
+
+private:
+    // 槽位数：比保留的段多两个，被删除的段在槽位复用前还能被迟到的读者读完
+    static const size_t SLOTS = MAX_SEGMENTS + 2;
+    static const size_t INDEX_SLOTS = SEGMENT_SIZE / sizeof(RecordHeader) / INDEX_INTERVAL + 1;
+    static const uint64_t SEALED = uint64_t(1) << 63; // state 的最高位：段已封住，不再追加
+
+    // 一个段。段按创建顺序编号（number），放在 number % SLOTS 号槽位
+    struct Segment {
+        std::atomic<uint64_t> number{0};    // 段号
+        std::atomic<uint64_t> base{0};      // 第一条消息的编号
+        char *data = nullptr;               // 整个文件的映射
+        // 低 32 位：已预留的字节；32-62 位：已预留的条数；最高位：SEALED
+        alignas(64) std::atomic<uint64_t> state{0};
+        std::atomic<uint64_t> written{0};   // 已写完的字节，等于预留字节时没有进行中的追加
+        alignas(64) std::atomic<int> readers{0}; // 钉住这个段的读者数
+        // 稀疏索引：第 k 项是第 k * INDEX_INTERVAL 条记录的偏移，0 表示还没写（k = 0 除外）
+        std::unique_ptr<std::atomic<uint32_t>[]> index;
+    };
+
+    std::string dir;
+    Segment slots[SLOTS];
+    std::atomic<uint64_t> first{0};     // 最旧的段号
+    std::atomic<uint64_t> last{0};      // 活动段的段号
+    std::mutex roll_mtx;                // 换段和刷盘时持有，追加和读取不用
+    uint64_t synced_number = 0;         // sync() 刷过的段
+    size_t synced = 0;                  // 以及刷到的偏移
+
+    static uint64_t state_end(uint64_t state) {
+        return state & 0xFFFFFFFFu;
+    }
+
+    static uint64_t state_count(uint64_t state) {
+        return (state & ~SEALED) >> 32;
+    }
+
+    Segment &slot(uint64_t number) {
+        return slots[number % SLOTS];
+    }
+
+    const Segment &slot(uint64_t number) const {
+        return slots[number % SLOTS];
+    }
+
+    // 段里最后一条消息之后的编号
+    static uint64_t end_seq(const Segment &segment) {
+        return segment.base + state_count(segment.state.load(std::memory_order_acquire));
+    }
+
+    std::string segment_path(uint64_t base) const {
+        char name[32];
+        snprintf(name, sizeof(name), "%020llu.seg", static_cast<unsigned long long>(base));
+        return dir + "/" + name;
+    }
+
+    static uint32_t record_crc(uint64_t seq, const char *data, size_t len) {
+        return checksum::crc32(data, len, checksum::crc32(&seq, sizeof(seq)));
+    }
+
+    // 往预留好的位置写一条记录并发布
+    void write_record(Segment &segment, uint64_t end, uint64_t count, uint64_t seq, const char *data, size_t len) {
+        char *at = segment.data + end;
+        RecordHeader *header = reinterpret_cast<RecordHeader *>(at);
+        memcpy(at + sizeof(RecordHeader), data, len);
+        header->seq = seq;
+        header->crc = record_crc(seq, data, len);
+        if (count % INDEX_INTERVAL == 0) {
+            segment.index[count / INDEX_INTERVAL].store(static_cast<uint32_t>(end), std::memory_order_release);
+        }
+        // 长度最后写：进程在这之前崩溃，这条记录就像没写过
+        __atomic_store_n(&header->length, static_cast<uint32_t>(len), __ATOMIC_RELEASE);
+        segment.written.fetch_add(record_size(len), std::memory_order_release);
+    }
+
+    // 钉住一个段，防止它的映射被解除；段已被删除时返回 false
+    bool pin(uint64_t number) {
+        Segment &segment = slot(number);
+        segment.readers.fetch_add(1);
+        if (number < first.load() || segment.number.load() != number) {
+            segment.readers.fetch_sub(1);
+            return false;
+        }
+        return true;
+    }
+
+    void unpin(uint64_t number) {
+        slot(number).readers.fetch_sub(1, std::memory_order_release);
+    }
+
+    // 编号 seq 所在的段号（按段的起始编号二分）；比最旧的还旧时返回最旧的段。
+    // 读到的可能是正在变化的值，调用者钉住之后还会再检查
+    uint64_t locate(uint64_t seq) const {
+        uint64_t low = first.load(), high = last.load(std::memory_order_acquire);
+        while (low < high) {
+            uint64_t mid = low + (high - low + 1) / 2;
+            if (slot(mid).base <= seq) {
+                low = mid;
+            } else {
+                high = mid - 1;
+            }
+        }
+        return low;
+    }
+
+    // 段内不晚于 seq 的那条记录的偏移：按编号直接算出索引项，还没写的项往前退
+    static size_t seek(const Segment &segment, uint64_t seq) {
+        if (seq <= segment.base) {
+            return 0;
+        }
+        size_t k = std::min<uint64_t>((seq - segment.base) / INDEX_INTERVAL, INDEX_SLOTS - 1);
+        for (; k > 0; k--) {
+            if (uint32_t offset = segment.index[k].load(std::memory_order_acquire)) {
+                return offset;
+            }
+        }
+        return 0;
+    }
+
+    // 映射一个段文件，不存在就创建成 SEGMENT_SIZE 字节的全 0 文件
+    char *map(uint64_t base) {
+        std::string path = segment_path(base);
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd == -1 || ftruncate(fd, SEGMENT_SIZE) == -1) {
+            std::cerr << "无法打开段文件 " << path << ": " << strerror(errno) << std::endl;
+            if (fd != -1) {
+                close(fd);
+            }
+            return nullptr;
+        }
+        void *data = mmap(nullptr, SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd); // 映射自己持有文件
+        if (data == MAP_FAILED) {
+            std::cerr << "无法映射段文件 " << path << ": " << strerror(errno) << std::endl;
+            return nullptr;
+        }
+        return static_cast<char *>(data);
+    }
+
+    // 把以 base 开头的段放进 number 号槽位并设为活动段。槽位里的旧段早已删除，
+    // 等最后的读者离开后解除它的映射
+    bool install(uint64_t number, uint64_t base) {
+        Segment &segment = slot(number);
+        while (segment.readers.load() != 0) {
+            std::this_thread::yield();
+        }
+        char *data = map(base);
+        if (!data) {
+            return false;
+        }
+        if (segment.data) {
+            munmap(segment.data, SEGMENT_SIZE);
+        }
+        if (!segment.index) {
+            segment.index.reset(new std::atomic<uint32_t>[INDEX_SLOTS]);
+        }
+        for (size_t k = 0; k < INDEX_SLOTS; k++) {
+            segment.index[k].store(0, std::memory_order_relaxed);
+        }
+        segment.data = data;
+        segment.base = base;
+        segment.written.store(0, std::memory_order_relaxed);
+        segment.number.store(number);
+        segment.state.store(0, std::memory_order_release);
+        last.store(number, std::memory_order_release);
+        // 保留的段太多就删除最旧的；映射留到槽位复用时再解除
+        while (number - first.load() + 1 > MAX_SEGMENTS) {
+            unlink(segment_path(slot(first.load()).base).c_str());
+            first.fetch_add(1);
+        }
+        return true;
+    }
+
+    // 恢复一个已有的段：校验每条记录，重建索引，到第一条无效记录为止
+    bool load(uint64_t base, bool after) {
+        uint64_t number = after ? last.load() + 1 : 0;
+        if (!install(number, base)) {
+            return false;
+        }
+        Segment &segment = slot(number);
+        uint64_t end = 0, count = 0;
+        while (end + sizeof(RecordHeader) <= SEGMENT_SIZE) {
+            const RecordHeader *header = reinterpret_cast<const RecordHeader *>(segment.data + end);
+            if (header->length == 0 || end + record_size(header->length) > SEGMENT_SIZE ||
+                header->seq != base + count ||
+                header->crc != record_crc(base + count, segment.data + end + sizeof(RecordHeader), header->length)) {
+                break;
+            }
+            if (count % INDEX_INTERVAL == 0) {
+                segment.index[count / INDEX_INTERVAL].store(static_cast<uint32_t>(end), std::memory_order_relaxed);
+            }
+            end += record_size(header->length);
+            count++;
+        }
+        segment.written.store(end);
+        segment.state.store(count << 32 | end);
+        if (number > 0) {
+            slot(number - 1).state.fetch_or(SEALED); // 只有最后一个段接着追加
+        }
+        return true;
+    }
+
+    // 活动段的有效数据之后应当全是 0，不是的话就是写了一半的记录，清掉它，
+    // 新的追加才不会和旧字节连成看似有效的记录。更早的段在换段时已经刷过盘
+    void truncate_tail(Segment &segment) {
+        size_t end = state_end(segment.state.load());
+        const char *tail = segment.data + end;
+        size_t rest = SEGMENT_SIZE - end;
+        if (rest > 0 && (tail[0] != 0 || memcmp(tail, tail + 1, rest - 1) != 0)) {
+            std::cerr << "段 " << segment_path(segment.base) << " 在偏移 " << end << " 处截断" << std::endl;
+            memset(segment.data + end, 0, rest);
+            msync(segment.data, SEGMENT_SIZE, MS_SYNC);
+        }
+    }
+
+    // number 号段已封住：等它进行中的追加写完、刷盘，再开下一个段。
+    // 几个线程同时发现段满时只有一个真正换段，其余的等它完成后重试
+    bool roll(uint64_t number) {
+        std::lock_guard<std::mutex> guard(roll_mtx);
+        if (last.load() != number) {
+            return true;
+        }
+        Segment &segment = slot(number);
+        uint64_t state = segment.state.load(std::memory_order_acquire);
+        while (segment.written.load(std::memory_order_acquire) != state_end(state)) {
+            std::this_thread::yield();
+        }
+        msync(segment.data, state_end(state), MS_SYNC);
+        return install(number + 1, end_seq(segment));
+    }
+};
+
+} // namespace store
+
+#endif // MESSAGE_STORE_H
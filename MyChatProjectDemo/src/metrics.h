@@ -0,0 +1,322 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <event2/event.h>
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/http.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 各服务共用的指标库（仅头文件），以 Prometheus 文本格式在 /metrics 上暴露。
+// 计数器、仪表和直方图都按线程分片：每个线程只写自己的分片（独占缓存行），
+// 热路径上没有锁也没有跨核争用；抓取时才把所有分片加起来。
+namespace metrics {
+
+const int MAX_SHARDS = 64;      // 分片数，超过的线程会共用分片（写入仍是原子的）
+const int MAX_BUCKETS = 24;     // 直方图最多的桶数（含 +Inf）
+
+// 当前线程使用的分片编号，第一次调用时分配
+inline int shard_index() {
+    static std::atomic<int> next(0);
+    thread_local int index = next.fetch_add(1) % MAX_SHARDS;
+    return index;
+}
+
+// 单个分片，独占一条缓存行
+struct alignas(64) Cell {
+    std::atomic<int64_t> value{0};
+};
+
+class Metric;
+
+// 全局注册表：指标在启动时注册，抓取时遍历；热路径不会碰到这里的锁
+class Registry {
+public:
+    static Registry &instance() {
+        static Registry registry;
+        return registry;
+    }
+
+    void add(Metric *metric) {
+        std::lock_guard<std::mutex> guard(mtx);
+        all.push_back(metric);
+    }
+
+    // 生成全部指标的文本
+    std::string render();
+
+private:
+    std::mutex mtx;
+    std::vector<Metric *> all;
+};
+
+// 指标基类：名字、说明、类型和固定的标签（如 service="chat_server"）
+class Metric {
+public:
+    Metric(const std::string &name, const std::string &help, const char *type, const std::string &labels)
+        : name(name), help(help), type(type), labels(labels) {
+        Registry::instance().add(this);
+    }
+    virtual ~Metric() {}
+
+    // 输出 HELP/TYPE 行和样本行；同名指标（标签不同）只在第一个前面输出 HELP/TYPE
+    void render(std::string &out, bool header = true) const {
+        if (header) {
+            out += "# HELP " + name + " " + help + "\n";
+            out += "# TYPE " + name + " " + type + "\n";
+        }
+        render_samples(out);
+    }
+
+    const std::string &metric_name() const {
+        return name;
+    }
+
+protected:
+    std::string name;
+    std::string help;
+    const char *type;
+    std::string labels;
+
+    virtual void render_samples(std::string &out) const = 0;
+
+    // 输出一行样本，extra 是追加的标签（如 le="0.5"）
+    void sample(std::string &out, const std::string &suffix, const std::string &extra, double value) const {
+        std::string all_labels = labels;
+        if (!extra.empty()) {
+            all_labels += (all_labels.empty() ? "" : ",") + extra;
+        }
+        char text[64];
+        snprintf(text, sizeof(text), "%.17g", value);
+        out += name + suffix;
+        if (!all_labels.empty()) {
+            out += "{" + all_labels + "}";
+        }
+        out += " ";
+        out += text;
+        out += "\n";
+    }
+};
+
+inline std::string Registry::render() {
+    std::lock_guard<std::mutex> guard(mtx);
+    // 同名的指标要连在一起输出，按名字稳定排序，其余保持注册顺序
+    std::vector<Metric *> sorted(all);
+    std::stable_sort(sorted.begin(), sorted.end(), [](const Metric *a, const Metric *b) {
+        return a->metric_name() < b->metric_name();
+    });
+    std::string out;
+    for (size_t i = 0; i < sorted.size(); i++) {
+        sorted[i]->render(out, i == 0 || sorted[i]->metric_name() != sorted[i - 1]->metric_name());
+    }
+    return out;
+}
+
+// 只增不减的计数器
+class Counter : public Metric {
+public:
+    Counter(const std::string &name, const std::string &help, const std::string &labels = "")
+        : Metric(name, help, "counter", labels) {}
+
+    void inc(int64_t n = 1) {
+        shards[shard_index()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    int64_t value() const {
+        int64_t total = 0;
+        for (const Cell &cell : shards) {
+            total += cell.value.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+private:
+    Cell shards[MAX_SHARDS];
+
+    void render_samples(std::string &out) const override {
+        sample(out, "", "", static_cast<double>(value()));
+    }
+};
+
+// 可增可减的仪表；也可以给一个函数，在抓取时取值（如队列长度）
+class Gauge : public Metric {
+public:
+    Gauge(const std::string &name, const std::string &help, const std::string &labels = "",
+          std::function<double()> sampler = nullptr)
+        : Metric(name, help, "gauge", labels), sampler(sampler) {}
+
+    void add(int64_t n) {
+        shards[shard_index()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    void sub(int64_t n) {
+        add(-n);
+    }
+
+    double value() const {
+        if (sampler) {
+            return sampler();
+        }
+        int64_t total = 0;
+        for (const Cell &cell : shards) {
+            total += cell.value.load(std::memory_order_relaxed);
+        }
+        return static_cast<double>(total);
+    }
+
+private:
+    Cell shards[MAX_SHARDS];
+    std::function<double()> sampler;
+
+    void render_samples(std::string &out) const override {
+        sample(out, "", "", value());
+    }
+};
+
+// 固定桶的直方图，单位秒；每个分片有自己的一组桶
+class Histogram : public Metric {
+public:
+    Histogram(const std::string &name, const std::string &help, const std::string &labels = "",
+              const std::vector<double> &bounds = default_bounds())
+        : Metric(name, help, "histogram", labels), bounds(bounds) {
+        if (this->bounds.size() > MAX_BUCKETS - 1) {
+            this->bounds.resize(MAX_BUCKETS - 1);
+        }
+    }
+
+    void observe(double seconds) {
+        size_t i = 0;
+        while (i < bounds.size() && seconds > bounds[i]) {
+            i++;
+        }
+        Shard &shard = shards[shard_index()];
+        shard.buckets[i].fetch_add(1, std::memory_order_relaxed);
+        shard.sum_ns.fetch_add(static_cast<uint64_t>(seconds * 1e9), std::memory_order_relaxed);
+    }
+
+    // 50us 到 5s 的默认桶
+    static std::vector<double> default_bounds() {
+        return {0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01,
+                0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5};
+    }
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> buckets[MAX_BUCKETS];
+        std::atomic<uint64_t> sum_ns;
+        Shard() : sum_ns(0) {
+            for (auto &bucket : buckets) {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    std::vector<double> bounds;
+    Shard shards[MAX_SHARDS];
+
+    void render_samples(std::string &out) const override {
+        uint64_t cumulative = 0;
+        uint64_t sum_ns = 0;
+        for (size_t i = 0; i <= bounds.size(); i++) {
+            for (const Shard &shard : shards) {
+                cumulative += shard.buckets[i].load(std::memory_order_relaxed);
+            }
+            char le[32];
+            if (i < bounds.size()) {
+                snprintf(le, sizeof(le), "le=\"%g\"", bounds[i]);
+            } else {
+                snprintf(le, sizeof(le), "le=\"+Inf\"");
+            }
+            sample(out, "_bucket", le, static_cast<double>(cumulative));
+        }
+        for (const Shard &shard : shards) {
+            sum_ns += shard.sum_ns.load(std::memory_order_relaxed);
+        }
+        sample(out, "_sum", "", sum_ns / 1e9);
+        sample(out, "_count", "", static_cast<double>(cumulative));
+    }
+};
+
+// 每个服务都有的一组指标，名字相同，用 service 标签区分
+class ServiceMetrics {
+public:
+    explicit ServiceMetrics(const std::string &service)
+        : labels("service=\"" + service + "\""),
+          connections_total("connections_total", "Accepted connections", labels),
+          connections("connections", "Open connections", labels),
+          requests("requests_total", "Requests handled", labels),
+          errors("errors_total", "Connection errors and bad requests", labels),
+          bytes_in("bytes_in_total", "Bytes received from clients", labels),
+          bytes_out("bytes_out_total", "Bytes written to clients", labels),
+          output_queue("output_queue_bytes", "Bytes waiting in output buffers", labels),
+          latency("request_duration_seconds", "Time to handle one request", labels) {}
+
+    std::string labels;
+    Counter connections_total;
+    Gauge connections;
+    Counter requests;
+    Counter errors;
+    Counter bytes_in;
+    Counter bytes_out;
+    Gauge output_queue;
+    Histogram latency;
+
+    // 新连接：计数，并跟踪它输出缓冲区的长度和实际写出的字节
+    void connection_opened(struct bufferevent *bev) {
+        connections_total.inc();
+        connections.add(1);
+        evbuffer_add_cb(bufferevent_get_output(bev), output_cb, this);
+    }
+
+    // 连接关闭：还没写出的字节不再算在队列里
+    void connection_closed(struct bufferevent *bev) {
+        connections.sub(1);
+        output_queue.sub(evbuffer_get_length(bufferevent_get_output(bev)));
+    }
+
+    // 一个请求处理完：记下读到的字节和耗时
+    void request_done(size_t bytes, std::chrono::steady_clock::time_point start) {
+        requests.inc();
+        bytes_in.inc(bytes);
+        latency.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+
+private:
+    static void output_cb(struct evbuffer *buffer, const struct evbuffer_cb_info *info, void *arg) {
+        auto *self = static_cast<ServiceMetrics *>(arg);
+        self->output_queue.add(static_cast<int64_t>(info->n_added) - static_cast<int64_t>(info->n_deleted));
+        self->bytes_out.inc(info->n_deleted);
+    }
+};
+
+// 在 base 上开一个 HTTP 监听，GET /metrics 返回全部指标
+inline bool serve(struct event_base *base, int port) {
+    struct evhttp *http = evhttp_new(base);
+    if (!http || evhttp_bind_socket(http, "0.0.0.0", port) != 0) {
+        std::cerr << "无法在端口 " << port << " 提供 /metrics" << std::endl;
+        return false;
+    }
+    evhttp_set_cb(http, "/metrics", [](struct evhttp_request *req, void *) {
+        std::string body = Registry::instance().render();
+        struct evbuffer *reply = evbuffer_new();
+        evbuffer_add(reply, body.data(), body.size());
+        evhttp_add_header(evhttp_request_get_output_headers(req), "Content-Type",
+                          "text/plain; version=0.0.4");
+        evhttp_send_reply(req, HTTP_OK, "OK", reply);
+        evbuffer_free(reply);
+    }, nullptr);
+    return true;
+}
+
+} // namespace metrics
+
+#endif // METRICS_H
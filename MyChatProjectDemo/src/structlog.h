@@ -0,0 +1,801 @@
+#ifndef STRUCTLOG_H
+#define STRUCTLOG_H
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <strings.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "log_writer.h"
+#include "checksum.h"
+
+// 结构化日志的二进制格式（仅头文件），log_server 写、log_query 读。
+//
+// 一条记录：时间戳（微秒）、服务名、级别，加若干 key=value 字段。请求行开头的
+// key=value（空格分隔）是字段，service= 和 level= 是专门的两个，其余部分是正文，
+// 存成字段 msg；没有 key=value 的纯文本整行就是 msg。
+//
+// 文件由若干块组成，每块最多约 BLOCK_RAW_BYTES 字节（解压后）：
+//   文件头 | 块 | 块 | ... | 索引
+// 块 = 块头 | 布隆过滤器 | 内容。块头里有块内时间戳和级别的最小/最大值；紧跟着
+// 的布隆过滤器覆盖 service 和各字段（msg 除外），按块内不同取值的个数定长度，
+// 只有一两条记录的小块只多几个字节（对 user、room 这类取值不太多的字段有效，
+// 每条都不同的字段几乎排除不了块）；块内的字段名和服务名只存一次，记录里只引用编号，整块再用简单的
+// LZ77 压缩（不依赖 zlib）。文件关闭时在末尾写所有块的索引（偏移、时间范围、
+// 级别范围），查询先读索引，只碰时间范围相交的块；正在写的文件还没有索引，
+// 就沿着块头一个个跳过去，也不必解压不相关的块。
+//
+// 所有整数按本机字节序（小端）存放，文件只在同一类机器之间使用。
+namespace slog {
+
+const uint32_t FILE_MAGIC = 0x474f4c53;     // "SLOG"
+const uint32_t BLOCK_MAGIC = 0x4b4c4253;    // "SBLK"
+const uint32_t INDEX_MAGIC = 0x58444953;    // "SIDX"
+const uint32_t VERSION = 2;                 // 2：布隆过滤器变长，放在块头之后
+const size_t BLOCK_RAW_BYTES = 64 << 10;    // 块的目标大小（解压后）
+const size_t BLOOM_BITS_PER_VALUE = 10;     // 3 个哈希时误判约 2%
+const size_t BLOOM_MIN_BYTES = 8;
+const size_t BLOOM_MAX_BYTES = 8 << 10;     // 取值再多也不超过 64K 位
+const int BLOOM_HASHES = 3;
+
+enum Level : uint8_t {
+    DEBUG = 0,
+    INFO = 1,
+    WARN = 2,
+    ERROR = 3,
+};
+
+const char *const LEVEL_NAMES[] = {"debug", "info", "warn", "error"};
+
+struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+};
+
+struct BlockHeader {
+    uint32_t magic;
+    uint32_t stored_len;    // 布隆过滤器之后的内容字节数
+    uint32_t raw_len;       // 解压后的字节数
+    uint32_t count;         // 记录数
+    uint64_t min_ts;        // 块内最早和最晚的时间戳（微秒）
+    uint64_t max_ts;
+    uint8_t min_level;
+    uint8_t max_level;
+    uint8_t compressed;     // 0 表示压缩不划算，原样存放
+    uint8_t reserved;
+    uint32_t crc;           // 布隆过滤器和存放内容的 CRC32
+    uint32_t bloom_len;     // 紧跟块头的布隆过滤器字节数
+    uint32_t reserved2;
+};
+
+// 索引里的一项，对应一个块
+struct IndexEntry {
+    uint64_t offset;        // 块头在文件里的偏移
+    uint64_t min_ts;
+    uint64_t max_ts;
+    uint32_t count;
+    uint8_t min_level;
+    uint8_t max_level;
+    uint16_t reserved;
+};
+
+// 索引：IndexHeader | IndexEntry * count | Trailer，Trailer 是文件的最后 16 字节
+struct IndexHeader {
+    uint32_t magic;
+    uint32_t count;
+};
+
+struct Trailer {
+    uint64_t index_offset;  // IndexHeader 的偏移
+    uint32_t count;
+    uint32_t magic;
+};
+
+inline uint64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+inline bool parse_level(const char *name, size_t len, uint8_t *level) {
+    for (uint8_t i = 0; i < 4; i++) {
+        if (strlen(LEVEL_NAMES[i]) == len && strncasecmp(name, LEVEL_NAMES[i], len) == 0) {
+            *level = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline void put_varint(std::string *out, uint64_t value) {
+    while (value >= 0x80) {
+        *out += static_cast<char>(value | 0x80);
+        value >>= 7;
+    }
+    *out += static_cast<char>(value);
+}
+
+inline bool get_varint(const char *&p, const char *end, uint64_t *value) {
+    uint64_t result = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t byte = *p++;
+        result |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline void put_string(std::string *out, const char *data, size_t len) {
+    put_varint(out, len);
+    out->append(data, len);
+}
+
+inline bool get_string(const char *&p, const char *end, const char **data, size_t *len) {
+    uint64_t n;
+    if (!get_varint(p, end, &n) || n > static_cast<size_t>(end - p)) {
+        return false;
+    }
+    *data = p;
+    *len = n;
+    p += n;
+    return true;
+}
+
+// 布隆过滤器用的 "key=value" 哈希（FNV-1a）
+inline uint64_t field_hash(const char *key, size_t key_len, const char *value, size_t value_len) {
+    uint64_t h = 14695981039346656037ull;
+    auto mix = [&h](const char *p, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            h = (h ^ static_cast<uint8_t>(p[i])) * 1099511628211ull;
+        }
+    };
+    mix(key, key_len);
+    mix("=", 1);
+    mix(value, value_len);
+    return h;
+}
+
+// n 个不同取值用的布隆过滤器字节数
+inline size_t bloom_size(size_t n) {
+    return std::min(BLOOM_MAX_BYTES, std::max(BLOOM_MIN_BYTES, (n * BLOOM_BITS_PER_VALUE + 7) / 8));
+}
+
+inline void bloom_add(uint8_t *bloom, size_t len, uint64_t h) {
+    uint64_t step = (h >> 32) | 1;
+    for (int i = 0; i < BLOOM_HASHES; i++) {
+        uint64_t bit = (h + i * step) % (len * 8);
+        bloom[bit / 8] |= 1 << (bit % 8);
+    }
+}
+
+// false 表示块里肯定没有这个字段值
+inline bool bloom_may_contain(const uint8_t *bloom, size_t len, uint64_t h) {
+    uint64_t step = (h >> 32) | 1;
+    for (int i = 0; i < BLOOM_HASHES; i++) {
+        uint64_t bit = (h + i * step) % (len * 8);
+        if (!(bloom[bit / 8] & (1 << (bit % 8)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// LZ77 压缩：一串"字面量 + 回指"序列。每个序列以一个字节开头，高 4 位是字面量
+// 长度，低 4 位是回指长度减 4，取 15 时后面跟 255 进位的补充长度；然后是字面量、
+// 2 字节的回指距离。最后一个序列只有字面量。
+inline void lz_put_length(std::string *out, size_t len) {
+    while (len >= 255) {
+        *out += static_cast<char>(255);
+        len -= 255;
+    }
+    *out += static_cast<char>(len);
+}
+
+inline void lz_compress(const char *src, size_t n, std::string *out) {
+    const int HASH_BITS = 12;
+    const size_t MIN_MATCH = 4;
+    const size_t MAX_DISTANCE = 65535;
+    std::vector<uint32_t> table(1 << HASH_BITS, 0); // 4 字节序列最近一次出现的位置 + 1
+    size_t anchor = 0;
+    size_t i = 0;
+    auto emit = [&](size_t literal_end, size_t distance, size_t match_len) {
+        size_t literals = literal_end - anchor;
+        size_t extra = match_len ? match_len - MIN_MATCH : 0;
+        *out += static_cast<char>((std::min<size_t>(literals, 15) << 4) | std::min<size_t>(extra, 15));
+        if (literals >= 15) {
+            lz_put_length(out, literals - 15);
+        }
+        out->append(src + anchor, literals);
+        if (match_len) {
+            *out += static_cast<char>(distance & 0xFF);
+            *out += static_cast<char>(distance >> 8);
+            if (extra >= 15) {
+                lz_put_length(out, extra - 15);
+            }
+        }
+    };
+    while (i + MIN_MATCH <= n) {
+        uint32_t sequence;
+        memcpy(&sequence, src + i, sizeof(sequence));
+        uint32_t h = (sequence * 2654435761u) >> (32 - HASH_BITS);
+        size_t candidate = table[h];
+        table[h] = static_cast<uint32_t>(i + 1);
+        if (candidate == 0 || i - (candidate - 1) > MAX_DISTANCE ||
+            memcmp(src + candidate - 1, src + i, MIN_MATCH) != 0) {
+            i++;
+            continue;
+        }
+        size_t from = candidate - 1;
+        size_t len = MIN_MATCH;
+        while (i + len < n && src[from + len] == src[i + len]) {
+            len++;
+        }
+        emit(i, i - from, len);
+        i += len;
+        anchor = i;
+    }
+    emit(n, 0, 0);
+}
+
+// 解压到 dst（恰好 raw_len 字节）；数据损坏返回 false
+inline bool lz_decompress(const char *src, size_t n, char *dst, size_t raw_len) {
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(src);
+    const uint8_t *end = p + n;
+    size_t out = 0;
+    auto get_length = [&p, end](size_t *len) {
+        uint8_t byte;
+        do {
+            if (p == end) {
+                return false;
+            }
+            byte = *p++;
+            *len += byte;
+        } while (byte == 255);
+        return true;
+    };
+    while (p < end) {
+        uint8_t token = *p++;
+        size_t literals = token >> 4;
+        if (literals == 15 && !get_length(&literals)) {
+            return false;
+        }
+        if (literals > static_cast<size_t>(end - p) || literals > raw_len - out) {
+            return false;
+        }
+        memcpy(dst + out, p, literals);
+        p += literals;
+        out += literals;
+        if (p == end) {
+            break; // 最后一个序列
+        }
+        if (end - p < 2) {
+            return false;
+        }
+        size_t distance = p[0] | (p[1] << 8);
+        p += 2;
+        size_t len = (token & 15);
+        if (len == 15 && !get_length(&len)) {
+            return false;
+        }
+        len += 4;
+        if (distance == 0 || distance > out || len > raw_len - out) {
+            return false;
+        }
+        for (size_t k = 0; k < len; k++, out++) {
+            dst[out] = dst[out - distance]; // 回指可以和自己重叠，逐字节拷贝
+        }
+    }
+    return out == raw_len;
+}
+
+// 把一行日志（去掉 "/log " 之后的部分）编码成一条待写记录追加到 out，交给
+// GroupWriter；写线程里的 BlockFormat 再把它们编成块。
+// 待写记录：ts | level | 字段数 | service | (key | value)*，整数是 varint，
+// 字符串是 varint 长度加内容
+inline void encode_line(const char *line, size_t len, uint64_t ts, std::string *out) {
+    const char *p = line;
+    const char *end = line + len;
+    const char *service = "-";
+    size_t service_len = 1;
+    uint8_t level = INFO;
+    std::vector<std::pair<std::string, std::string>> fields;
+    while (p < end) {
+        while (p < end && *p == ' ') {
+            p++;
+        }
+        const char *token_end = static_cast<const char *>(memchr(p, ' ', end - p));
+        if (!token_end) {
+            token_end = end;
+        }
+        const char *eq = static_cast<const char *>(memchr(p, '=', token_end - p));
+        bool is_field = eq && eq > p;
+        for (const char *k = p; is_field && k < eq; k++) {
+            is_field = isalnum(static_cast<unsigned char>(*k)) || *k == '_' || *k == '.' || *k == '-';
+        }
+        if (!is_field) {
+            break; // 从这里开始是正文
+        }
+        size_t key_len = eq - p;
+        const char *value = eq + 1;
+        size_t value_len = token_end - value;
+        if (key_len == 7 && memcmp(p, "service", 7) == 0) {
+            service = value;
+            service_len = value_len;
+        } else if (!(key_len == 5 && memcmp(p, "level", 5) == 0 && parse_level(value, value_len, &level))) {
+            fields.emplace_back(std::string(p, key_len), std::string(value, value_len));
+        }
+        p = token_end;
+    }
+    if (p < end) {
+        fields.emplace_back("msg", std::string(p, end - p));
+    }
+    put_varint(out, ts);
+    *out += static_cast<char>(level);
+    put_varint(out, fields.size());
+    put_string(out, service, service_len);
+    for (auto &field : fields) {
+        put_string(out, field.first.data(), field.first.size());
+        put_string(out, field.second.data(), field.second.size());
+    }
+}
+
+// 块的解压后内容：字符串表（字段名和服务名）| 记录*，
+// 记录：时间戳与上一条之差（zigzag varint）| level | 服务名编号 | 字段数 |
+// (字段名编号 | 值)*
+class BlockBuilder {
+public:
+    bool empty() const {
+        return count == 0;
+    }
+
+    size_t size() const {
+        return table.size() + body.size();
+    }
+
+    // 加一条待写记录（从 p 开始解析）；格式不对返回 false，块里不留半条
+    bool add(const char *&p, const char *end) {
+        size_t body_size = body.size();
+        if (!parse(p, end)) {
+            body.resize(body_size);
+            return false;
+        }
+        count++;
+        return true;
+    }
+
+    // 把块写到 out 末尾并清空，返回它在索引里的一项（offset 由调用者填）
+    IndexEntry finish(std::string *out) {
+        std::string raw;
+        put_varint(&raw, strings);
+        raw += table;
+        raw += body;
+        std::string packed;
+        lz_compress(raw.data(), raw.size(), &packed);
+        bool compressed = packed.size() < raw.size();
+        const std::string &stored = compressed ? packed : raw;
+
+        std::string bloom(bloom_size(hashes.size()), '\0');
+        for (uint64_t h : hashes) {
+            bloom_add(reinterpret_cast<uint8_t *>(&bloom[0]), bloom.size(), h);
+        }
+
+        BlockHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = BLOCK_MAGIC;
+        header.stored_len = static_cast<uint32_t>(stored.size());
+        header.raw_len = static_cast<uint32_t>(raw.size());
+        header.count = count;
+        header.min_ts = min_ts;
+        header.max_ts = max_ts;
+        header.min_level = min_level;
+        header.max_level = max_level;
+        header.compressed = compressed;
+        header.crc = checksum::crc32(stored.data(), stored.size(), checksum::crc32(bloom.data(), bloom.size()));
+        header.bloom_len = static_cast<uint32_t>(bloom.size());
+        out->append(reinterpret_cast<const char *>(&header), sizeof(header));
+        out->append(bloom);
+        out->append(stored);
+
+        IndexEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.min_ts = min_ts;
+        entry.max_ts = max_ts;
+        entry.count = count;
+        entry.min_level = min_level;
+        entry.max_level = max_level;
+
+        table.clear();
+        body.clear();
+        ids.clear();
+        hashes.clear();
+        strings = 0;
+        count = 0;
+        previous_ts = 0;
+        return entry;
+    }
+
+private:
+    std::string table;
+    std::string body;
+    std::unordered_map<std::string, uint32_t> ids;
+    std::unordered_set<uint64_t> hashes;    // 要进布隆过滤器的不同取值
+    uint32_t strings = 0;
+    uint32_t count = 0;
+    uint64_t previous_ts = 0;
+    uint64_t min_ts = 0, max_ts = 0;
+    uint8_t min_level = 0, max_level = 0;
+
+    bool parse(const char *&p, const char *end) {
+        uint64_t ts, field_count;
+        const char *service;
+        size_t service_len;
+        if (!get_varint(p, end, &ts) || p == end) {
+            return false;
+        }
+        uint8_t level = *p++;
+        if (!get_varint(p, end, &field_count) || !get_string(p, end, &service, &service_len)) {
+            return false;
+        }
+        if (count == 0) {
+            min_ts = max_ts = ts;
+            min_level = max_level = level;
+        }
+        min_ts = std::min(min_ts, ts);
+        max_ts = std::max(max_ts, ts);
+        min_level = std::min(min_level, level);
+        max_level = std::max(max_level, level);
+        int64_t delta = static_cast<int64_t>(ts - previous_ts);
+        put_varint(&body, (static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63));
+        previous_ts = ts;
+        body += static_cast<char>(level);
+        put_varint(&body, intern(service, service_len));
+        hashes.insert(field_hash("service", 7, service, service_len));
+        put_varint(&body, field_count);
+        for (uint64_t i = 0; i < field_count; i++) {
+            const char *key, *value;
+            size_t key_len, value_len;
+            if (!get_string(p, end, &key, &key_len) || !get_string(p, end, &value, &value_len)) {
+                return false;
+            }
+            put_varint(&body, intern(key, key_len));
+            put_string(&body, value, value_len);
+            if (!(key_len == 3 && memcmp(key, "msg", 3) == 0)) {
+                hashes.insert(field_hash(key, key_len, value, value_len)); // 正文太分散，不进过滤器
+            }
+        }
+        return true;
+    }
+
+    uint32_t intern(const char *data, size_t len) {
+        auto inserted = ids.emplace(std::string(data, len), strings);
+        if (inserted.second) {
+            put_string(&table, data, len);
+            strings++;
+        }
+        return inserted.first->second;
+    }
+};
+
+// 把从 offset 开始的索引写到 out 末尾；没有块时什么也不写
+inline void append_index(const std::vector<IndexEntry> &index, uint64_t offset, std::string *out) {
+    if (index.empty()) {
+        return;
+    }
+    IndexHeader header = {INDEX_MAGIC, static_cast<uint32_t>(index.size())};
+    out->append(reinterpret_cast<const char *>(&header), sizeof(header));
+    out->append(reinterpret_cast<const char *>(index.data()), index.size() * sizeof(IndexEntry));
+    Trailer trailer = {offset, static_cast<uint32_t>(index.size()), INDEX_MAGIC};
+    out->append(reinterpret_cast<const char *>(&trailer), sizeof(trailer));
+}
+
+// 给 GroupWriter 用的文件格式：每批待写记录编成一个或几个块，文件末尾写索引
+class BlockFormat : public logwriter::Format {
+public:
+    void begin_file(std::string *out) override {
+        FileHeader header = {FILE_MAGIC, VERSION};
+        out->append(reinterpret_cast<const char *>(&header), sizeof(header));
+        offset = out->size();
+        index.clear();
+    }
+
+    // 一批结束时块也结束，不跨批：确认发出时对应的块已经完整落盘
+    void encode(const std::string &batch, std::string *out) override {
+        size_t start = out->size();
+        const char *p = batch.data();
+        const char *end = p + batch.size();
+        while (p < end) {
+            if (!builder.add(p, end)) {
+                std::cerr << "结构化日志: 待写记录格式错误，丢弃本批剩余部分" << std::endl;
+                break;
+            }
+            if (builder.size() >= BLOCK_RAW_BYTES) {
+                finish_block(out, start);
+            }
+        }
+        if (!builder.empty()) {
+            finish_block(out, start);
+        }
+        offset += out->size() - start;
+    }
+
+    // 索引覆盖自 begin_file 以来的所有块；轮转失败接着写时，下一份索引照样完整
+    void end_file(std::string *out) override {
+        size_t start = out->size();
+        append_index(index, offset, out);
+        offset += out->size() - start;
+    }
+
+    // 定义在 Reader 之后
+    void repair(const std::string &path) override;
+
+private:
+    BlockBuilder builder;
+    std::vector<IndexEntry> index;
+    uint64_t offset = 0; // 当前文件已写的字节数
+
+    void finish_block(std::string *out, size_t start) {
+        uint64_t at = offset + (out->size() - start);
+        IndexEntry entry = builder.finish(out);
+        entry.offset = at;
+        index.push_back(entry);
+    }
+};
+
+// 解出来的一条记录；字符串指向块的解压缓冲区，下一个块解压前有效
+struct Record {
+    struct Field {
+        const std::string *key;
+        const char *value;
+        size_t value_len;
+    };
+    uint64_t ts;
+    uint8_t level;
+    const std::string *service;
+    std::vector<Field> fields;
+};
+
+// 只读映射一个日志文件
+class Reader {
+public:
+    ~Reader() {
+        if (data) {
+            munmap(const_cast<char *>(data), size);
+        }
+    }
+
+    bool open(const std::string &path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            std::cerr << "无法打开 " << path << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == -1 || static_cast<size_t>(st.st_size) < sizeof(FileHeader)) {
+            close(fd);
+            std::cerr << path << ": 不是结构化日志文件" << std::endl;
+            return false;
+        }
+        size = st.st_size; // 正在写的文件只看打开这一刻的长度
+        void *mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            std::cerr << "无法映射 " << path << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        data = static_cast<const char *>(mapped);
+        FileHeader header;
+        memcpy(&header, data, sizeof(header));
+        if (header.magic != FILE_MAGIC || header.version != VERSION) {
+            std::cerr << path << ": 不是结构化日志文件" << std::endl;
+            return false;
+        }
+        madvise(mapped, size, MADV_RANDOM); // 只读用得到的块，别预读整个文件
+        return true;
+    }
+
+    // 列出所有块：有完整的索引就直接用（只读文件末尾），否则沿块头走一遍
+    // （只读每个块的头）；indexed 说明用的是哪种
+    std::vector<IndexEntry> blocks(bool *indexed) const {
+        std::vector<IndexEntry> entries;
+        *indexed = read_index(&entries);
+        if (!*indexed) {
+            walk(&entries, false);
+        }
+        return entries;
+    }
+
+    // 没有完整索引的文件：逐块校验 CRC，列出完好的块，返回有效数据的结尾；
+    // 已经有索引时返回 0
+    uint64_t recover(std::vector<IndexEntry> *entries) const {
+        std::vector<IndexEntry> index;
+        if (read_index(&index)) {
+            return 0;
+        }
+        return walk(entries, true);
+    }
+
+    // 读块头（块内容不读）；偏移不对返回 false
+    bool header(uint64_t offset, BlockHeader *header) const {
+        if (offset > size || size - offset < sizeof(BlockHeader)) {
+            return false;
+        }
+        memcpy(header, data + offset, sizeof(BlockHeader));
+        return header->magic == BLOCK_MAGIC && header->bloom_len >= BLOOM_MIN_BYTES &&
+               static_cast<uint64_t>(header->bloom_len) + header->stored_len <= size - offset - sizeof(BlockHeader);
+    }
+
+    // 块的布隆过滤器，header() 成功后才能用
+    const uint8_t *bloom(uint64_t offset) const {
+        return reinterpret_cast<const uint8_t *>(data + offset + sizeof(BlockHeader));
+    }
+
+    // 校验并解压一个块，逐条调用 fn(const Record &)；块损坏返回 false
+    template <typename F>
+    bool scan(uint64_t offset, const BlockHeader &header, F fn) {
+        if (!check_crc(offset, header)) {
+            return false;
+        }
+        const char *stored = data + offset + sizeof(BlockHeader) + header.bloom_len;
+        raw.resize(header.raw_len);
+        if (header.compressed) {
+            if (!lz_decompress(stored, header.stored_len, &raw[0], raw.size())) {
+                return false;
+            }
+        } else if (header.stored_len == header.raw_len) {
+            memcpy(&raw[0], stored, raw.size());
+        } else {
+            return false;
+        }
+        const char *p = raw.data();
+        const char *end = p + raw.size();
+        uint64_t string_count;
+        if (!get_varint(p, end, &string_count) || string_count > raw.size()) {
+            return false;
+        }
+        strings.resize(string_count);
+        for (auto &s : strings) {
+            const char *str;
+            size_t len;
+            if (!get_string(p, end, &str, &len)) {
+                return false;
+            }
+            s.assign(str, len);
+        }
+        Record record;
+        record.ts = 0;
+        for (uint32_t i = 0; i < header.count; i++) {
+            uint64_t zigzag, service, field_count;
+            if (!get_varint(p, end, &zigzag) || p == end) {
+                return false;
+            }
+            record.ts += (zigzag >> 1) ^ (~(zigzag & 1) + 1);
+            record.level = *p++;
+            if (!get_varint(p, end, &service) || service >= strings.size() ||
+                !get_varint(p, end, &field_count) || field_count > static_cast<size_t>(end - p)) {
+                return false;
+            }
+            record.service = &strings[service];
+            record.fields.resize(field_count);
+            for (auto &field : record.fields) {
+                uint64_t key;
+                if (!get_varint(p, end, &key) || key >= strings.size() ||
+                    !get_string(p, end, &field.value, &field.value_len)) {
+                    return false;
+                }
+                field.key = &strings[key];
+            }
+            fn(record);
+        }
+        return true;
+    }
+
+private:
+    const char *data = nullptr;
+    size_t size = 0;
+    std::string raw;                    // 当前块的解压内容
+    std::vector<std::string> strings;   // 当前块的字符串表
+
+    // 校验布隆过滤器和块内容的 CRC
+    bool check_crc(uint64_t offset, const BlockHeader &header) const {
+        const char *start = data + offset + sizeof(BlockHeader);
+        return checksum::crc32(start + header.bloom_len, header.stored_len, checksum::crc32(start, header.bloom_len)) ==
+               header.crc;
+    }
+
+    bool read_index(std::vector<IndexEntry> *entries) const {
+        Trailer trailer;
+        if (size < sizeof(FileHeader) + sizeof(IndexHeader) + sizeof(Trailer)) {
+            return false;
+        }
+        memcpy(&trailer, data + size - sizeof(Trailer), sizeof(trailer));
+        uint64_t expected = sizeof(IndexHeader) + static_cast<uint64_t>(trailer.count) * sizeof(IndexEntry) + sizeof(Trailer);
+        if (trailer.magic != INDEX_MAGIC || trailer.index_offset > size || size - trailer.index_offset != expected) {
+            return false;
+        }
+        IndexHeader header;
+        memcpy(&header, data + trailer.index_offset, sizeof(header));
+        if (header.magic != INDEX_MAGIC || header.count != trailer.count) {
+            return false;
+        }
+        entries->resize(trailer.count);
+        memcpy(entries->data(), data + trailer.index_offset + sizeof(IndexHeader), trailer.count * sizeof(IndexEntry));
+        return true;
+    }
+
+    // 从头沿块头走；中间的文件头和旧索引（轮转失败时留下的）跳过，
+    // 遇到写了一半的尾巴就停，返回停下的位置。verify 时还校验块内容
+    uint64_t walk(std::vector<IndexEntry> *entries, bool verify) const {
+        uint64_t offset = sizeof(FileHeader);
+        while (size - offset >= sizeof(uint32_t)) {
+            uint32_t magic;
+            memcpy(&magic, data + offset, sizeof(magic));
+            if (magic == FILE_MAGIC && size - offset >= sizeof(FileHeader)) {
+                offset += sizeof(FileHeader);
+            } else if (magic == INDEX_MAGIC && size - offset >= sizeof(IndexHeader)) {
+                IndexHeader header;
+                memcpy(&header, data + offset, sizeof(header));
+                uint64_t len = sizeof(IndexHeader) + static_cast<uint64_t>(header.count) * sizeof(IndexEntry) + sizeof(Trailer);
+                if (len > size - offset) {
+                    break;
+                }
+                offset += len;
+            } else {
+                BlockHeader block;
+                if (!header(offset, &block) || (verify && !check_crc(offset, block))) {
+                    break;
+                }
+                IndexEntry entry;
+                memset(&entry, 0, sizeof(entry));
+                entry.offset = offset;
+                entry.min_ts = block.min_ts;
+                entry.max_ts = block.max_ts;
+                entry.count = block.count;
+                entry.min_level = block.min_level;
+                entry.max_level = block.max_level;
+                entries->push_back(entry);
+                offset += sizeof(BlockHeader) + block.bloom_len + block.stored_len;
+            }
+        }
+        return offset;
+    }
+};
+
+inline void BlockFormat::repair(const std::string &path) {
+    std::vector<IndexEntry> entries;
+    uint64_t end;
+    {
+        Reader reader;
+        if (!reader.open(path) || (end = reader.recover(&entries)) == 0) {
+            return; // 不是这种格式，或者本来就完整
+        }
+    }
+    std::string index;
+    append_index(entries, end, &index);
+    int fd = ::open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd == -1 || ftruncate(fd, end) == -1 || pwrite(fd, index.data(), index.size(), end) != static_cast<ssize_t>(index.size()) ||
+        fsync(fd) == -1) {
+        std::cerr << "无法修复日志文件 " << path << ": " << strerror(errno) << std::endl;
+    } else {
+        std::cerr << "日志文件 " << path << " 上次没有正常关闭，已补上 " << entries.size() << " 个块的索引" << std::endl;
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+}
+
+} // namespace slog
+
+#endif // STRUCTLOG_H
@@ -0,0 +1,183 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include <event2/event.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 各服务共用的工作线程池（仅头文件）。主线程的 event_base 只负责 accept（以及
+// /metrics 等杂事），接受的 fd 交给连接最少的工作线程；每个工作线程有自己的
+// event_base，连接从此只在那个线程上处理，bufferevent 不会跨线程使用。
+//
+// 交接只用 eventfd 唤醒，不跨线程调用 libevent，所以不需要 evthread_use_pthreads
+// 和 -levent_pthreads。
+namespace workers {
+
+// 新连接的处理函数，在工作线程上调用；arg 是 start() 时给的参数
+typedef void (*Handler)(struct event_base *base, evutil_socket_t fd, void *arg);
+
+// 一个工作线程
+struct Worker {
+    struct event_base *base = nullptr;
+    int wake_fd = -1;                   // eventfd：有新 fd 或要退出时写它
+    struct event *wake_event = nullptr;
+    std::mutex mtx;                     // 只保护 incoming，每个线程一把
+    std::vector<evutil_socket_t> incoming;
+    std::atomic<int> load{0};           // 当前连接数，挑选线程时用
+    std::atomic<bool> stopping{false};
+    std::thread th;
+};
+
+// 当前线程所属的工作线程，主线程上是 nullptr
+inline Worker *&current() {
+    thread_local Worker *worker = nullptr;
+    return worker;
+}
+
+class Pool {
+public:
+    ~Pool() {
+        stop();
+    }
+
+    // 启动 count 个工作线程；init（可以为空）在每个线程开始事件循环前调用一次，
+    // 用来建立线程自己的状态
+    bool start(int count, Handler handler, void *arg = nullptr, void (*init)(struct event_base *base) = nullptr) {
+        this->handler = handler;
+        this->arg = arg;
+        for (int i = 0; i < count; i++) {
+            std::unique_ptr<Worker> worker(new Worker());
+            worker->base = event_base_new();
+            worker->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (!worker->base || worker->wake_fd == -1) {
+                std::cerr << "无法创建工作线程的事件循环" << std::endl;
+                return false;
+            }
+            worker->wake_event = event_new(worker->base, worker->wake_fd, EV_READ | EV_PERSIST, wake_cb, this);
+            event_add(worker->wake_event, nullptr);
+            Worker *w = worker.get();
+            worker->th = std::thread([this, w, init] {
+                current() = w;
+                if (init) {
+                    init(w->base);
+                }
+                event_base_dispatch(w->base);
+            });
+            pool.push_back(std::move(worker));
+        }
+        return true;
+    }
+
+    bool running() const {
+        return !pool.empty();
+    }
+
+    // 把一个刚接受的 fd 交给连接最少的工作线程（在接受线程上调用）
+    void dispatch(evutil_socket_t fd) {
+        Worker *best = pool[next++ % pool.size()].get();  // 连接数相同时轮流
+        for (auto &worker : pool) {
+            if (worker->load.load(std::memory_order_relaxed) < best->load.load(std::memory_order_relaxed)) {
+                best = worker.get();
+            }
+        }
+        best->load.fetch_add(1, std::memory_order_relaxed);
+        bool first;
+        {
+            std::lock_guard<std::mutex> guard(best->mtx);
+            first = best->incoming.empty();
+            best->incoming.push_back(fd);
+        }
+        if (first) {
+            wake(best);
+        }
+    }
+
+    // 让所有工作线程退出并等它们结束
+    void stop() {
+        for (auto &worker : pool) {
+            worker->stopping = true;
+            wake(worker.get());
+        }
+        for (auto &worker : pool) {
+            if (worker->th.joinable()) {
+                worker->th.join();
+            }
+            event_free(worker->wake_event);
+            event_base_free(worker->base);
+            close(worker->wake_fd);
+        }
+        pool.clear();
+    }
+
+private:
+    std::vector<std::unique_ptr<Worker>> pool;
+    Handler handler = nullptr;
+    void *arg = nullptr;
+    size_t next = 0;
+
+    static void wake(Worker *worker) {
+        uint64_t one = 1;
+        ssize_t n = write(worker->wake_fd, &one, sizeof(one));
+        (void)n;
+    }
+
+    // 工作线程被唤醒：取走交过来的 fd，逐个建立连接
+    static void wake_cb(evutil_socket_t fd, short events, void *arg) {
+        auto *self = static_cast<Pool *>(arg);
+        Worker *worker = current();
+        uint64_t count;
+        ssize_t n = read(fd, &count, sizeof(count));
+        (void)n;
+        if (worker->stopping) {
+            event_base_loopbreak(worker->base);
+            return;
+        }
+        std::vector<evutil_socket_t> batch;
+        {
+            std::lock_guard<std::mutex> guard(worker->mtx);
+            batch.swap(worker->incoming);
+        }
+        for (evutil_socket_t client : batch) {
+            self->handler(worker->base, client, self->arg);
+        }
+    }
+};
+
+// 连接关闭时调用，让挑选线程时的连接数保持准确；不在工作线程上时什么也不做
+inline void connection_closed() {
+    if (Worker *worker = current()) {
+        worker->load.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+// 从命令行取 --workers N：N 个工作线程，0 表示原来的单线程模式，-1 表示每个 CPU
+// 一个；其余参数原样留下
+inline int parse_workers(int &argc, char **argv) {
+    int count = 0;
+    int out = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            count = atoi(argv[++i]);
+            if (count < 0) {
+                count = static_cast<int>(std::thread::hardware_concurrency());
+            }
+        } else {
+            argv[out++] = argv[i];
+        }
+    }
+    argc = out;
+    return count;
+}
+
+} // namespace workers
+
+#endif // WORKERS_H
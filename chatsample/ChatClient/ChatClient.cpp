@@ -0,0 +1,157 @@
+#include "ChatClient.h"
+
+ChatClient* ChatClient::instance = nullptr;
+mutex ChatClient::cout_mtx;
+
+ChatClient::ChatClient(const string &server_ip, int server_port) {
+    client_socket = socket(AF_INET, SOCK_STREAM, 0);
+    if (client_socket == -1) {
+        perror("socket");
+        exit(EXIT_FAILURE);
+    }
+
+    struct sockaddr_in client;
+    client.sin_family = AF_INET;
+    client.sin_port = htons(server_port);
+    client.sin_addr.s_addr = inet_addr(server_ip.c_str());
+    memset(&client.sin_zero, 0, sizeof(client.sin_zero));
+
+    if (connect(client_socket, (struct sockaddr *)&client, sizeof(struct sockaddr_in)) == -1) {
+        perror("connect");
+        close(client_socket);
+        exit(EXIT_FAILURE);
+    }
+}
+
+void ChatClient::start() {
+    signal(SIGINT, catch_ctrl_c);
+    instance = this; // Set the instance for static function
+
+    string name;
+    cout << "输入你的姓名 : ";
+    getline(cin, name);
+    send_frame(FRAME_HELLO, name, "");
+
+    cout << colors[NUM_COLORS - 1] << "\n\t  ====== 欢迎加入聊天室 ======   " << endl
+         << def_col;
+
+    t_send = thread(&ChatClient::send_message, this);
+    t_recv = thread(&ChatClient::recv_message, this);
+
+    if (t_send.joinable())
+        t_send.join();
+    if (t_recv.joinable())
+        t_recv.join();
+}
+
+void ChatClient::stop() {
+    exit_flag = true;
+    if (t_send.joinable()) {
+        t_send.detach();
+    }
+    if (t_recv.joinable()) {
+        t_recv.detach();
+    }
+    close(client_socket);
+}
+
+void ChatClient::catch_ctrl_c(int signal) {
+    if (instance) {
+        instance->send_frame(FRAME_CHAT, "", "#exit");
+        instance->stop();
+        exit(signal);
+    }
+}
+
+string ChatClient::color(int code) {
+    return colors[code % NUM_COLORS];
+}
+
+void ChatClient::eraseText(int cnt) {
+    lock_guard<mutex> guard(cout_mtx);
+    for (int i = 0; i < cnt; i++) {
+        cout << "\b \b";
+    }
+    cout.flush();
+}
+
+void ChatClient::send_message() {
+    while (true) {
+        cout << colors[1] << "你 : " << def_col;
+        string str;
+        if (!getline(cin, str)) {
+            str = "#exit";
+        }
+        // Frames carry the exact length, so long lines are sent whole
+        send_frame(FRAME_CHAT, "", str);
+        if (str == "#exit") {
+            stop();
+            break;
+        }
+    }
+}
+
+void ChatClient::recv_message() {
+    Frame frame;
+    while (!exit_flag) {
+        if (!receive()) {
+            continue;
+        }
+        while (next_frame(frame)) {
+            print_frame(frame);
+        }
+        if (failed()) {
+            cerr << "Error: malformed frame from server" << endl;
+            stop();
+            break;
+        }
+    }
+}
+
+void ChatClient::send_frame(uint8_t type, const string &name, const string &payload) {
+    string frame = encode_frame(type, 0, name, payload);
+    send(client_socket, frame.data(), frame.size(), MSG_NOSIGNAL);
+}
+
+bool ChatClient::receive() {
+    char buf[4096];
+    int bytes_received = recv(client_socket, buf, sizeof(buf), 0);
+    if (bytes_received <= 0) {
+        return false;
+    }
+    // A single recv may carry several frames or only part of one
+    decoder.feed(buf, bytes_received);
+    return true;
+}
+
+bool ChatClient::next_frame(Frame &frame) {
+    // Pings are answered here, so neither the terminal nor a headless
+    // caller has to know about them
+    while (decoder.next(frame)) {
+        if (frame.type != FRAME_PING) {
+            return true;
+        }
+        send_frame(FRAME_PONG, "", "");
+    }
+    return false;
+}
+
+bool ChatClient::failed() const {
+    return decoder.error();
+}
+
+int ChatClient::fd() const {
+    return client_socket;
+}
+
+void ChatClient::print_frame(const Frame &frame) {
+    eraseText(6);
+    lock_guard<mutex> guard(cout_mtx);
+    if (frame.type == FRAME_CHAT) {
+        cout << color(frame.sender_id) << frame.name << " : " << def_col << frame.payload << endl;
+    } else {
+        cout << color(frame.sender_id) << frame.payload << endl;
+    }
+    cout << colors[1] << "你 : " << def_col;
+    cout.flush();
+}
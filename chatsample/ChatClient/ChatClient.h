@@ -0,0 +1,57 @@
+#ifndef CHATCLIENT_H
+#define CHATCLIENT_H
+
+#include <bits/stdc++.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <thread>
+#include <signal.h>
+#include <mutex>
+
+#include "src/Protocol.h"
+
+#define NUM_COLORS 6
+#define CLIENT_MAX_FRAME_LEN (16 * 1024 * 1024) // Accept whatever the server relays
+
+using namespace std;
+
+class ChatClient {
+public:
+    ChatClient(const string &server_ip, int server_port);
+
+    // Interactive session: reads lines from cin and prints what arrives
+    void start();
+    void stop();
+
+    // Headless use: the caller sends frames and pulls received ones itself
+    void send_frame(uint8_t type, const string &name, const string &payload);
+    bool receive();                 // One recv into the decoder; false if nothing came
+    bool next_frame(Frame &frame);  // Next complete received frame; pings are answered
+    bool failed() const;            // Whether the server sent a malformed frame
+    int fd() const;
+
+private:
+    int client_socket;
+    bool exit_flag = false;
+    thread t_send, t_recv;
+    FrameDecoder decoder{CLIENT_MAX_FRAME_LEN};
+    string def_col = "\033[0m";
+    string colors[NUM_COLORS] = {"\033[31m", "\033[32m", "\033[33m", "\033[34m", "\033[35m", "\033[36m"};
+
+    static void catch_ctrl_c(int signal);
+    string color(int code);
+    void eraseText(int cnt);
+    void send_message();
+    void recv_message();
+    void print_frame(const Frame &frame);
+
+    static ChatClient *instance; // For handling Ctrl+C
+    static mutex cout_mtx; // For synchronizing cout statements
+};
+
+#endif // CHATCLIENT_H
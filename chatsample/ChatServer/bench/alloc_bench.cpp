@@ -0,0 +1,149 @@
+// Allocation benchmark: heap allocations per chat message in steady state.
+//
+// Runs a ChatServer with two reactors in-process, connects the clients,
+// warms every pool and the logger ring up, then broadcasts messages from
+// all clients in turn and reads the allocation counters the server keeps
+// through Alloc.cpp. The expected result is 0 allocations per message.
+// Usage: alloc_bench [clients] [messages] [--io-uring]
+
+#include <bits/stdc++.h>
+
+#include <netinet/tcp.h>
+
+#include "src/ChatServer.h"
+
+using namespace std;
+
+static const int PORT = 10001;
+static const int WINDOW = 256;      // Messages in flight before waiting
+static const int WARMUP = 70000;    // More than the logger ring holds
+
+static atomic<long> received(0);    // Chat frames read by all clients
+
+// Method to connect one client and introduce it; returns once the server
+// has put it in the room, so every broadcast reaches all clients
+static int connect_client(int index) {
+    for (int attempt = 0; attempt < 100; attempt++) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in server;
+        server.sin_family = AF_INET;
+        server.sin_port = htons(PORT);
+        server.sin_addr.s_addr = inet_addr("127.0.0.1");
+        memset(&server.sin_zero, 0, sizeof(server.sin_zero));
+        if (connect(fd, (sockaddr*)&server, sizeof(server)) == 0) {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            // The reply to #users comes after the hello has been handled
+            string hello = encode_frame(FRAME_HELLO, 0, "bench" + to_string(index), "") +
+                           encode_frame(FRAME_CHAT, 0, "", "#users");
+            send(fd, hello.data(), hello.size(), MSG_NOSIGNAL);
+            FrameDecoder decoder;
+            Frame frame;
+            char buf[4096];
+            while (!decoder.next(frame)) {
+                ssize_t n = recv(fd, buf, sizeof(buf), 0);
+                if (n <= 0) {
+                    perror("recv: ");
+                    exit(EXIT_FAILURE);
+                }
+                decoder.feed(buf, n);
+            }
+            return fd;
+        }
+        close(fd);
+        this_thread::sleep_for(chrono::milliseconds(20));
+    }
+    perror("connect: ");
+    exit(EXIT_FAILURE);
+}
+
+// Method to read everything a client receives, counting chat frames
+static void read_client(int fd) {
+    FrameDecoder decoder;
+    Frame frame;
+    char buf[65536];
+    while (true) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            return;
+        }
+        decoder.feed(buf, n);
+        while (decoder.next(frame)) {
+            if (frame.type == FRAME_CHAT) {
+                received++;
+            }
+        }
+    }
+}
+
+// Method to broadcast count messages, a window at a time, and wait until
+// every other client has read them
+static void broadcast(const vector<int>& fds, int count) {
+    long expected = received.load();
+    string payload(32, 'x');
+    for (int sent = 0; sent < count;) {
+        int batch = min(WINDOW, count - sent);
+        for (int i = 0; i < batch; i++, sent++) {
+            int fd = fds[sent % fds.size()];
+            string frame = encode_frame(FRAME_CHAT, 0, "", payload);
+            send(fd, frame.data(), frame.size(), MSG_NOSIGNAL);
+        }
+        expected += static_cast<long>(batch) * (fds.size() - 1);
+        while (received.load() < expected) {
+            this_thread::yield();
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int clients = 8;
+    int messages = 200000;
+    bool io_uring = false;
+    int positional = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--io-uring") == 0) {
+            io_uring = true;
+        } else if (positional++ == 0) {
+            clients = max(2, atoi(argv[i]));
+        } else {
+            messages = atoi(argv[i]);
+        }
+    }
+
+    // The server runs until the process exits; a static object, since
+    // ChatServer holds cache-line aligned slots that a plain C++11 new
+    // would not align
+    static ChatServer server(PORT, 2);
+    server.get_logger().set_console(false);
+    if (io_uring) {
+        server.set_backend(ChatServer::BACKEND_IO_URING);
+    }
+    thread([] { server.start(); }).detach();
+
+    vector<int> fds;
+    for (int i = 0; i < clients; i++) {
+        fds.push_back(connect_client(i));
+        thread(read_client, fds.back()).detach();
+    }
+
+    ChatServer::AllocStats cold = server.alloc_stats();
+    broadcast(fds, WARMUP);
+    ChatServer::AllocStats before = server.alloc_stats();
+    auto start = chrono::steady_clock::now();
+    broadcast(fds, messages);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    ChatServer::AllocStats after = server.alloc_stats();
+
+    uint64_t count = after.messages - before.messages;
+    uint64_t allocations = after.allocations - before.allocations;
+    printf("backend      %s\n", io_uring ? "io_uring" : "epoll");
+    printf("clients      %d\n", clients);
+    printf("messages     %llu (%.0f/s, %llu deliveries)\n", (unsigned long long)count, count / seconds,
+           (unsigned long long)count * (clients - 1));
+    printf("warm-up      %llu allocations over %d messages\n",
+           (unsigned long long)(before.allocations - cold.allocations), WARMUP);
+    printf("allocations  %llu (%.4f per message)\n", (unsigned long long)allocations,
+           count ? static_cast<double>(allocations) / count : 0.0);
+    fflush(stdout);
+    _exit(0);
+}
@@ -0,0 +1,179 @@
+// Load generator: many ChatClient users against a running server.
+//
+// Opens --users connections from one process, names them, then has the
+// first --senders of them chat at --rate messages per second in total for
+// --seconds. Each payload starts with the time it was due to be sent, so
+// the receivers measure the end-to-end broadcast latency of every
+// delivery; a sender that falls behind schedule is charged for the delay
+// instead of hiding it (no coordinated omission).
+// Usage: load_bench [--host 127.0.0.1] [--port 10000] [--users 50]
+//                   [--senders users] [--rate 1000] [--size 64] [--seconds 10]
+
+#include <bits/stdc++.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+
+#include "../ChatClient/ChatClient.h"
+#include "src/Histogram.h"
+
+using namespace std;
+
+static const int STAMP_LEN = 20;    // Decimal nanoseconds at the payload start
+
+struct Options {
+    string host = "127.0.0.1";
+    int port = 10000;
+    int users = 50;
+    int senders = 0;                // 0 means every user sends
+    double rate = 1000;             // Messages per second, all senders together
+    size_t size = 64;               // Payload bytes, at least STAMP_LEN
+    double seconds = 10;
+};
+
+static atomic<bool> sending(true);  // Cleared once the last message is sent
+static atomic<long> received(0);    // Chat frames read by all users
+static uint64_t run_start;          // Stamps before this are from earlier runs
+
+// Method to read the monotonic clock in nanoseconds
+static uint64_t now_ns() {
+    return chrono::duration_cast<chrono::nanoseconds>(
+               chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Method to connect and name one user; returns once the server has put it
+// in the room, so every later broadcast reaches it. The room's history,
+// replayed ahead of the reply to #users, is discarded
+static ChatClient* join(const Options& options, int index) {
+    ChatClient* client = new ChatClient(options.host, options.port);
+    int one = 1;
+    setsockopt(client->fd(), IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    client->send_frame(FRAME_HELLO, "load" + to_string(index), "");
+    // The reply to #users comes after the hello has been handled
+    client->send_frame(FRAME_CHAT, "", "#users");
+    Frame frame;
+    while (true) {
+        while (client->next_frame(frame)) {
+            if (frame.type == FRAME_SYSTEM) {
+                return client;
+            }
+        }
+        if (!client->receive()) {
+            cerr << "Error: server closed user " << index << endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+// Method to read every user's frames until sending is over and the
+// deliveries stop, recording the latency of each chat frame sent by this run
+static void read_all(const vector<ChatClient*>& clients, Histogram& latency) {
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    for (ChatClient* client : clients) {
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = client;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client->fd(), &ev);
+    }
+
+    vector<epoll_event> events(clients.size());
+    Frame frame;
+    while (true) {
+        // Once sending has stopped, a quiet second means everything arrived
+        int n = epoll_wait(epoll_fd, events.data(), events.size(), sending ? 100 : 1000);
+        if (n == 0 && !sending) {
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            ChatClient* client = static_cast<ChatClient*>(events[i].data.ptr);
+            if (!client->receive()) {
+                continue;
+            }
+            uint64_t now = now_ns();
+            while (client->next_frame(frame)) {
+                if (frame.type != FRAME_CHAT || frame.payload.size() < STAMP_LEN) {
+                    continue;
+                }
+                uint64_t stamp = strtoull(frame.payload.c_str(), nullptr, 10);
+                if (stamp >= run_start) {
+                    latency.record(now - stamp);
+                    received++;
+                }
+            }
+        }
+    }
+    close(epoll_fd);
+}
+
+// Method to send options.rate messages per second for options.seconds,
+// round-robin over the senders
+static long send_all(const vector<ChatClient*>& clients, const Options& options) {
+    int senders = options.senders > 0 ? min(options.senders, options.users) : options.users;
+    long total = static_cast<long>(options.rate * options.seconds);
+    double interval = 1e9 / options.rate;
+    string payload(max(options.size, static_cast<size_t>(STAMP_LEN)), 'x');
+    uint64_t start = now_ns();
+
+    for (long i = 0; i < total; i++) {
+        uint64_t due = start + static_cast<uint64_t>(i * interval);
+        uint64_t now = now_ns();
+        if (now < due) {
+            this_thread::sleep_for(chrono::nanoseconds(due - now));
+        }
+        // Stamped with the scheduled time, not the actual one
+        char stamp[STAMP_LEN + 1];
+        snprintf(stamp, sizeof(stamp), "%0*llu", STAMP_LEN, static_cast<unsigned long long>(due));
+        memcpy(&payload[0], stamp, STAMP_LEN);
+        clients[i % senders]->send_frame(FRAME_CHAT, "", payload);
+    }
+    sending = false;
+    return total;
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string flag = argv[i];
+        const char* value = argv[i + 1];
+        if (flag == "--host") {
+            options.host = value;
+        } else if (flag == "--port") {
+            options.port = atoi(value);
+        } else if (flag == "--users") {
+            options.users = max(2, atoi(value));
+        } else if (flag == "--senders") {
+            options.senders = atoi(value);
+        } else if (flag == "--rate") {
+            options.rate = max(1.0, atof(value));
+        } else if (flag == "--size") {
+            options.size = strtoul(value, nullptr, 10);
+        } else if (flag == "--seconds") {
+            options.seconds = atof(value);
+        } else {
+            cerr << "Unknown option " << flag << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    run_start = now_ns();
+    vector<ChatClient*> clients;
+    for (int i = 0; i < options.users; i++) {
+        clients.push_back(join(options, i));
+    }
+
+    Histogram latency;
+    thread reader(read_all, cref(clients), ref(latency));
+    uint64_t start = now_ns();
+    long sent = send_all(clients, options);
+    double send_seconds = (now_ns() - start) / 1e9;
+    reader.join();
+
+    long expected = sent * (options.users - 1);
+    printf("users        %d\n", options.users);
+    printf("sent         %ld messages of %zu bytes (%.0f/s)\n", sent,
+           max(options.size, static_cast<size_t>(STAMP_LEN)), sent / send_seconds);
+    printf("delivered    %ld of %ld (%.0f/s)\n", received.load(), expected, received.load() / send_seconds);
+    printf("latency us   p50 %.1f  p99 %.1f  p999 %.1f  max %.1f\n",
+           latency.percentile(50) / 1e3, latency.percentile(99) / 1e3,
+           latency.percentile(99.9) / 1e3, latency.max() / 1e3);
+    return received.load() == expected ? 0 : 1;
+}
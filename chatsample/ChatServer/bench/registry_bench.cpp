@@ -0,0 +1,117 @@
+// Contention benchmark: ClientRegistry versus the old vector + mutex design.
+//
+// Reader threads play the broadcaster and walk every client; one writer
+// thread plays connect/disconnect churn and removes and re-adds clients.
+// Usage: registry_bench [readers] [seconds per run]
+
+#include <bits/stdc++.h>
+
+#include "src/ClientRegistry.h"
+
+using namespace std;
+
+// The directory as it used to be: vector scanned under one mutex
+class MutexRegistry {
+public:
+    void insert(int id, const string& name) {
+        lock_guard<mutex> guard(mtx);
+        clients.push_back({id, name});
+    }
+
+    bool remove(int id) {
+        lock_guard<mutex> guard(mtx);
+        auto it = find_if(clients.begin(), clients.end(), [id](const pair<int, string>& client) {
+            return client.first == id;
+        });
+        if (it == clients.end()) {
+            return false;
+        }
+        clients.erase(it);
+        return true;
+    }
+
+    template <typename F>
+    void for_each(F fn) const {
+        lock_guard<mutex> guard(mtx);
+        for (const auto& client : clients) {
+            fn(client.first, client.second);
+        }
+    }
+
+private:
+    mutable mutex mtx;
+    vector<pair<int, string>> clients;
+};
+
+struct Result {
+    double reads_per_sec;   // Full walks per second, all readers together
+    double writes_per_sec;  // remove + insert pairs per second
+};
+
+template <typename Registry>
+Result run(int clients, int num_readers, double seconds) {
+    Registry registry;
+    for (int id = 0; id < clients; id++) {
+        registry.insert(id, "user" + to_string(id));
+    }
+
+    atomic<bool> stop(false);
+    atomic<long> reads(0);
+    atomic<long> writes(0);
+    vector<thread> threads;
+
+    for (int r = 0; r < num_readers; r++) {
+        threads.emplace_back([&] {
+            long local = 0;
+            long sink = 0;
+            while (!stop.load(memory_order_relaxed)) {
+                registry.for_each([&sink](int id, const string& name) {
+                    sink += id + name.size();
+                });
+                local++;
+            }
+            reads += local;
+            if (sink == -1) {
+                cout << "";
+            }
+        });
+    }
+    threads.emplace_back([&] {
+        mt19937 rng(42);
+        long local = 0;
+        while (!stop.load(memory_order_relaxed)) {
+            int id = rng() % clients;
+            registry.remove(id);
+            registry.insert(id, "user" + to_string(id));
+            local++;
+        }
+        writes += local;
+    });
+
+    this_thread::sleep_for(chrono::duration<double>(seconds));
+    stop = true;
+    for (auto& t : threads) {
+        t.join();
+    }
+    return Result{reads / seconds, writes / seconds};
+}
+
+int main(int argc, char* argv[]) {
+    int num_readers = argc > 1 ? atoi(argv[1]) : max(1u, thread::hardware_concurrency() - 1);
+    double seconds = argc > 2 ? atof(argv[2]) : 1.0;
+
+    cout << "readers=" << num_readers << " seconds=" << seconds << endl;
+    cout << left << setw(10) << "clients" << setw(14) << "design"
+         << setw(16) << "walks/s" << setw(16) << "churn ops/s" << endl;
+    for (int clients : {1000, 10000, 100000}) {
+        Result old_design = run<MutexRegistry>(clients, num_readers, seconds);
+        Result new_design = run<ClientRegistry<string>>(clients, num_readers, seconds);
+        cout << left << setw(10) << clients << setw(14) << "mutex+vector"
+             << setw(16) << fixed << setprecision(0) << old_design.reads_per_sec
+             << setw(16) << old_design.writes_per_sec << endl;
+        cout << left << setw(10) << clients << setw(14) << "epoch"
+             << setw(16) << new_design.reads_per_sec
+             << setw(16) << new_design.writes_per_sec << endl;
+    }
+    return 0;
+}
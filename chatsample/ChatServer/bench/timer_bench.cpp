@@ -0,0 +1,104 @@
+// Timer benchmark: TimerWheel versus an ordered multimap of deadlines.
+//
+// Every connection owns a liveness timer that is re-armed whenever data
+// arrives, so the hot operations are re-arm and, once a tick passes, the
+// expiry of whatever came due. Each round re-arms a random tenth of the
+// timers and advances the clock by one millisecond.
+// Usage: timer_bench [timers] [rounds]
+
+#include <bits/stdc++.h>
+
+#include "src/TimerWheel.h"
+
+using namespace std;
+
+static const uint64_t INTERVAL = 30000; // Heartbeat interval in ticks (ms)
+
+struct Result {
+    double rearm_ns;    // Per re-arm
+    double advance_ns;  // Per advance, expiries included
+    long fired;
+};
+
+static double elapsed_ns(chrono::steady_clock::time_point since) {
+    return chrono::duration<double, nano>(chrono::steady_clock::now() - since).count();
+}
+
+Result run_wheel(size_t count, int rounds, const vector<uint32_t>& picks) {
+    TimerWheel wheel(0);
+    vector<TimerWheel::Timer> timers(count);
+    long fired = 0;
+    for (size_t i = 0; i < count; i++) {
+        timers[i].callback = [&fired]() { fired++; };
+        wheel.schedule(&timers[i], 1 + i % INTERVAL);
+    }
+
+    double rearm = 0, advance = 0;
+    size_t pick = 0;
+    for (int round = 1; round <= rounds; round++) {
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < count / 10; i++) {
+            wheel.schedule(&timers[picks[pick++ % picks.size()]], round + INTERVAL);
+        }
+        rearm += elapsed_ns(start);
+        start = chrono::steady_clock::now();
+        wheel.advance(round);
+        advance += elapsed_ns(start);
+    }
+    return {rearm / (rounds * (count / 10)), advance / rounds, fired};
+}
+
+// The usual alternative: deadlines in a tree, each timer remembering its node
+Result run_multimap(size_t count, int rounds, const vector<uint32_t>& picks) {
+    multimap<uint64_t, size_t> deadlines;
+    vector<multimap<uint64_t, size_t>::iterator> nodes(count);
+    long fired = 0;
+    for (size_t i = 0; i < count; i++) {
+        nodes[i] = deadlines.emplace(1 + i % INTERVAL, i);
+    }
+
+    double rearm = 0, advance = 0;
+    size_t pick = 0;
+    for (int round = 1; round <= rounds; round++) {
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < count / 10; i++) {
+            size_t timer = picks[pick++ % picks.size()];
+            if (nodes[timer] != deadlines.end()) {
+                deadlines.erase(nodes[timer]);
+            }
+            nodes[timer] = deadlines.emplace(round + INTERVAL, timer);
+        }
+        rearm += elapsed_ns(start);
+        start = chrono::steady_clock::now();
+        while (!deadlines.empty() && deadlines.begin()->first <= static_cast<uint64_t>(round)) {
+            nodes[deadlines.begin()->second] = deadlines.end();
+            deadlines.erase(deadlines.begin());
+            fired++;
+        }
+        advance += elapsed_ns(start);
+    }
+    return {rearm / (rounds * (count / 10)), advance / rounds, fired};
+}
+
+int main(int argc, char* argv[]) {
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 1000;
+    if (count < 10 || rounds <= 0) {
+        cerr << "Usage: timer_bench [timers] [rounds]" << endl;
+        return 1;
+    }
+
+    mt19937 rng(42);
+    vector<uint32_t> picks(1 << 20);
+    for (auto& pick : picks) {
+        pick = rng() % count;
+    }
+
+    Result wheel = run_wheel(count, rounds, picks);
+    Result tree = run_multimap(count, rounds, picks);
+    printf("%zu timers, %d rounds, %zu re-arms per round\n", count, rounds, count / 10);
+    printf("%-10s %12s %14s %10s\n", "", "re-arm ns", "advance us", "fired");
+    printf("%-10s %12.1f %14.1f %10ld\n", "wheel", wheel.rearm_ns, wheel.advance_ns / 1000, wheel.fired);
+    printf("%-10s %12.1f %14.1f %10ld\n", "multimap", tree.rearm_ns, tree.advance_ns / 1000, tree.fired);
+    return 0;
+}
@@ -1,8 +1,57 @@
 #include "src/ChatServer.h"
 
-int main() {
+int main(int argc, char* argv[]) {
 
-    ChatServer server(10000);
+    // Optional arguments: number of event loop threads (one per core by
+    // default), a file that receives a plain copy of the log, --io-uring
+    // to drive the sockets through io_uring instead of epoll,
+    // --metrics <port> for the Prometheus endpoint (0 turns it off),
+    // --max-message <bytes> for the largest message a client may send, and
+    // --handoff <path> for hot restart: start the new binary with the same
+    // path and it takes over the running server's clients
+    int num_loops = 0;
+    const char* log_file = nullptr;
+    bool io_uring = false;
+    int metrics_port = 10100;
+    const char* handoff_path = nullptr;
+    const char* max_message = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--io-uring") == 0) {
+            io_uring = true;
+        } else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            metrics_port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--handoff") == 0 && i + 1 < argc) {
+            handoff_path = argv[++i];
+        } else if (strcmp(argv[i], "--max-message") == 0 && i + 1 < argc) {
+            max_message = argv[++i];
+        } else if (isdigit(static_cast<unsigned char>(argv[i][0]))) {
+            num_loops = atoi(argv[i]);
+        } else {
+            log_file = argv[i];
+        }
+    }
+
+    ChatServer server(10000, num_loops);
+    if (log_file) {
+        server.get_logger().open_file(log_file);
+    }
+    if (io_uring) {
+        server.set_backend(ChatServer::BACKEND_IO_URING);
+    }
+    server.set_metrics_port(metrics_port);
+    if (max_message) {
+        // Digits only: strtoull would turn "-1" into the largest value
+        char* end = nullptr;
+        unsigned long long bytes = strtoull(max_message, &end, 10);
+        if (!isdigit(static_cast<unsigned char>(max_message[0])) || *end != '\0' ||
+            bytes > FRAME_LIMIT_LEN || !server.set_max_message_size(bytes)) {
+            cerr << "--max-message 无效: " << max_message << " (1 到 " << FRAME_LIMIT_LEN << " 字节)" << endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (handoff_path) {
+        server.set_handoff_path(handoff_path);
+    }
     server.start();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,61 @@
+#include "Alloc.h"
+
+#include <stdlib.h>
+#include <new>
+
+static thread_local uint64_t allocations = 0;
+
+// Method to get the number of operator new calls made by this thread
+uint64_t thread_allocations() {
+    return allocations;
+}
+
+// Method to allocate from malloc, counting the call
+static void* counted_malloc(size_t size) {
+    allocations++;
+    return malloc(size == 0 ? 1 : size);
+}
+
+void* operator new(size_t size) {
+    void* p = counted_malloc(size);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return counted_malloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return counted_malloc(size);
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    free(p);
+}
@@ -0,0 +1,26 @@
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <stdint.h>
+#include <atomic>
+
+// Linking Alloc.cpp replaces the global operator new and delete with
+// versions that count every allocation made by the calling thread. The
+// count is a plain thread-local integer, so reading it around a piece of
+// code tells how many heap allocations that code made.
+
+// Method to get the number of operator new calls made by this thread
+uint64_t thread_allocations();
+
+// Struct to add the allocations made during its lifetime to a counter
+struct AllocScope {
+    std::atomic<uint64_t>& total;
+    uint64_t start;
+
+    explicit AllocScope(std::atomic<uint64_t>& total) : total(total), start(thread_allocations()) {}
+    ~AllocScope() {
+        total.fetch_add(thread_allocations() - start, std::memory_order_relaxed);
+    }
+};
+
+#endif // ALLOC_H
@@ -1,23 +1,356 @@
 #include "ChatServer.h"
+#include "Alloc.h"
+
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <future>
+
+// io_uring user_data carries a Terminal or Reactor pointer with the
+// operation in the low bits (both are at least 8-byte aligned)
+static const uint64_t URING_OP_MASK = 7;
+
+static uint64_t uring_tag(void* ptr, int op) {
+    return reinterpret_cast<uint64_t>(ptr) | static_cast<uint64_t>(op);
+}
+
+// Method to read the monotonic clock in nanoseconds (vDSO, no syscall)
+static uint64_t now_ns() {
+    return chrono::duration_cast<chrono::nanoseconds>(
+               chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Method to describe a latency histogram as "p50/p99/p999" in microseconds
+static string percentiles(const Histogram& histogram) {
+    char text[64];
+    snprintf(text, sizeof(text), "%.1f/%.1f/%.1f", histogram.percentile(50) / 1e3,
+             histogram.percentile(99) / 1e3, histogram.percentile(99.9) / 1e3);
+    return text;
+}
+
+// Method to append a metric with one sample in the Prometheus text format
+static void append_metric(string& out, const char* name, const char* type, const char* help, double value) {
+    char text[512];
+    snprintf(text, sizeof(text), "# HELP %s %s\n# TYPE %s %s\n%s %.17g\n", name, help, name, type, name, value);
+    out += text;
+}
+
+// Method to append a latency histogram (nanoseconds) as a summary in seconds
+static void append_summary(string& out, const char* name, const char* help, const Histogram& histogram) {
+    static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    char text[512];
+    snprintf(text, sizeof(text), "# HELP %s %s\n# TYPE %s summary\n", name, help, name);
+    out += text;
+    for (double quantile : quantiles) {
+        snprintf(text, sizeof(text), "%s{quantile=\"%g\"} %.9f\n", name, quantile,
+                 histogram.percentile(quantile * 100) / 1e9);
+        out += text;
+    }
+    snprintf(text, sizeof(text), "%s_count %llu\n", name, static_cast<unsigned long long>(histogram.count()));
+    out += text;
+}
+
+// Method to encode a frame into a pooled buffer
+static SharedBuffer make_frame(uint8_t type, int32_t sender_id, const string& name, const string& payload) {
+    SharedBuffer frame = SharedBuffer::allocate(frame_size(name.size(), payload.size()));
+    encode_frame_into(frame.data(), type, sender_id, name, payload);
+    return frame;
+}
 
 // Constructor to initialize the chat server with a given port
-ChatServer::ChatServer(int port) : port(port), def_col("\033[0m"), seed(0) {
+ChatServer::ChatServer(int port, int num_loops)
+    : def_col("\033[0m"), seed(0), port(port), num_loops(num_loops),
+      max_message_size(FRAME_MAX_LEN), backend(BACKEND_EPOLL), dropped_oldest(0), dropped_chat(0), disconnected(0),
+      metrics_port(0), metrics_socket(-1), handoff_socket(-1), handed_off(false), stopping(false), history_seq(0) {
     colors[0] = "\033[31m";
     colors[1] = "\033[32m";
     colors[2] = "\033[33m";
     colors[3] = "\033[34m";
     colors[4] = "\033[35m";
     colors[5] = "\033[36m";
+    if (this->num_loops <= 0) {
+        this->num_loops = max(1u, thread::hardware_concurrency());
+    }
+    limits.max_bytes = 1 << 20;
+    limits.max_frames = 4096;
+    limits.policy = DROP_OLDEST;
+    limits.grace_seconds = 10;
+    timeouts.handshake = 10;
+    timeouts.heartbeat = 30;
+    timeouts.idle = 90;
+    // A full replay fits in one sendmsg
+    history_limits.max_frames = MAX_IOV;
+    history_limits.max_bytes = 256 * 1024;
+}
+
+// Method to set the output limits; call before start()
+void ChatServer::set_output_limits(const OutputLimits& limits) {
+    this->limits = limits;
+}
+
+// Method to set the liveness timeouts; call before start()
+void ChatServer::set_timeouts(const Timeouts& timeouts) {
+    this->timeouts = timeouts;
+}
+
+// Method to set the per-room history limits; call before start()
+void ChatServer::set_history_limits(const HistoryLimits& limits) {
+    history_limits = limits;
+}
+
+// Method to choose the I/O backend; call before start()
+void ChatServer::set_backend(Backend backend) {
+    this->backend = backend;
+}
+
+// Method to set the largest accepted frame body; call before start()
+bool ChatServer::set_max_message_size(size_t bytes) {
+    if (bytes == 0 || bytes > FRAME_LIMIT_LEN) {
+        return false;
+    }
+    max_message_size = bytes;
+    return true;
+}
+
+// Method to serve Prometheus metrics over HTTP on a port; call before start()
+void ChatServer::set_metrics_port(int port) {
+    metrics_port = port;
+}
+
+// Method to enable hot restart through a Unix socket at path; call before start()
+void ChatServer::set_handoff_path(const string& path) {
+    handoff_path = path;
+}
+
+// Method to render every counter in the Prometheus text format
+string ChatServer::metrics_text() const {
+    uint64_t accepted = 0, closed = 0, bytes_in = 0, bytes_out = 0, errors = 0, messages = 0, allocations = 0;
+    uint64_t timed_out = 0;
+    int64_t queued = 0;
+    for (const auto& reactor : reactors) {
+        accepted += reactor->accepted.load(memory_order_relaxed);
+        closed += reactor->closed.load(memory_order_relaxed);
+        bytes_in += reactor->bytes_in.load(memory_order_relaxed);
+        bytes_out += reactor->bytes_out.load(memory_order_relaxed);
+        errors += reactor->errors.load(memory_order_relaxed);
+        timed_out += reactor->timed_out.load(memory_order_relaxed);
+        messages += reactor->messages.load(memory_order_relaxed);
+        allocations += reactor->allocations.load(memory_order_relaxed);
+        queued += reactor->queued_bytes.load(memory_order_relaxed);
+    }
+    OverflowStats overflow = overflow_stats();
+    LatencyStats latency;
+    latency_stats(latency);
+
+    string out;
+    append_metric(out, "chatserver_connections_total", "counter", "Accepted connections", accepted);
+    append_metric(out, "chatserver_connections", "gauge", "Open connections",
+                  static_cast<double>(accepted) - closed);
+    append_metric(out, "chatserver_messages_total", "counter", "Chat messages broadcast", messages);
+    append_metric(out, "chatserver_bytes_in_total", "counter", "Bytes read from clients", bytes_in);
+    append_metric(out, "chatserver_bytes_out_total", "counter", "Bytes written to clients", bytes_out);
+    append_metric(out, "chatserver_output_queue_bytes", "gauge", "Bytes waiting in client output queues", queued);
+    append_metric(out, "chatserver_errors_total", "counter", "Malformed frames and failed sends", errors);
+    append_metric(out, "chatserver_timeouts_total", "counter", "Clients dropped by the handshake or idle timeout",
+                  timed_out);
+    append_metric(out, "chatserver_dropped_oldest_total", "counter", "Frames dropped by DROP_OLDEST",
+                  overflow.dropped_oldest);
+    append_metric(out, "chatserver_dropped_chat_total", "counter", "Frames dropped by DROP_CHAT",
+                  overflow.dropped_chat);
+    append_metric(out, "chatserver_overflow_disconnects_total", "counter", "Clients closed by DISCONNECT",
+                  overflow.disconnected);
+    append_metric(out, "chatserver_log_dropped_total", "counter", "Log records lost to a full ring",
+                  logger.dropped());
+    append_metric(out, "chatserver_heap_allocations_total", "counter",
+                  "Heap allocations while handling client I/O", allocations);
+    append_summary(out, "chatserver_parse_seconds", "recv complete to frame parsed", latency.parse);
+    append_summary(out, "chatserver_fanout_seconds", "Frame parsed to broadcast queued", latency.fanout);
+    append_summary(out, "chatserver_queue_wait_seconds", "Frame queued to last byte written",
+                   latency.queue_wait);
+    append_summary(out, "chatserver_recv_to_send_seconds", "Chat message read to last byte written",
+                   latency.recv_to_send);
+    return out;
+}
+
+// Method to read the overflow counters (safe from any thread)
+ChatServer::OverflowStats ChatServer::overflow_stats() const {
+    return OverflowStats{dropped_oldest.load(), dropped_chat.load(), disconnected.load()};
+}
+
+// Method to read the allocation counters (safe from any thread)
+ChatServer::AllocStats ChatServer::alloc_stats() const {
+    AllocStats stats{0, 0};
+    for (const auto& reactor : reactors) {
+        stats.messages += reactor->messages.load(memory_order_relaxed);
+        stats.allocations += reactor->allocations.load(memory_order_relaxed);
+    }
+    return stats;
+}
+
+// Method to merge the latency histograms of every reactor into stats
+void ChatServer::latency_stats(LatencyStats& stats) const {
+    for (const auto& reactor : reactors) {
+        stats.parse.merge(reactor->latency.parse);
+        stats.fanout.merge(reactor->latency.fanout);
+        stats.queue_wait.merge(reactor->latency.queue_wait);
+        stats.recv_to_send.merge(reactor->latency.recv_to_send);
+    }
+}
+
+// Method to access the logger, e.g. to set its level or a file sink
+Logger& ChatServer::get_logger() {
+    return logger;
 }
 
 // Method to start the chat server
 void ChatServer::start() {
+    // Lift the descriptor limit so tens of thousands of idle clients fit
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    ping = make_frame(FRAME_PING, 0, "", "");
+
+    if (backend == BACKEND_IO_URING && !Uring::supported()) {
+        shared_print("io_uring 不可用, 改用 epoll", LOG_WARN);
+        backend = BACKEND_EPOLL;
+    }
+
+    // A server already running at the handoff path passes its sockets on
+    // instead of us binding new ones, so its clients stay connected
+    int link = -1;
+    vector<int> listeners;
+    vector<pair<string, int>> handed;
+    if (!handoff_path.empty() && (link = Handoff::connect(handoff_path)) != -1) {
+        receive_handoff(link, listeners, handed);
+        num_loops = max(num_loops, static_cast<int>(listeners.size()));
+    }
+
+    // Every reactor gets its own listener; the kernel spreads new
+    // connections across them through SO_REUSEPORT
+    for (int i = 0; i < num_loops; i++) {
+        unique_ptr<Reactor> reactor(new Reactor());
+        Reactor* r = reactor.get();
+        r->server_socket = i < static_cast<int>(listeners.size()) ? listeners[i] : open_listener();
+        if (backend == BACKEND_IO_URING) {
+            // The ring fd turns readable with completions, so the epoll loop
+            // still drives everything; sends queued during a round go to the
+            // kernel together right before the loop sleeps
+            // A small receive pool keeps TCP flow control in charge: a
+            // flooding client waits in its socket instead of in the ring
+            r->uring.reset(new Uring());
+            if (!r->uring->init(4096, 64, 4096)) {
+                perror("io_uring init: ");
+                exit(EXIT_FAILURE);
+            }
+            r->uring_channel.fd = r->uring->fd();
+            r->uring_channel.callback = [this, r](uint32_t) { handle_uring(r); };
+            r->loop.add(&r->uring_channel, EPOLLIN);
+            r->loop.set_before_wait([r] { r->uring->submit(); });
+            r->uring->prep_accept_multishot(r->server_socket, uring_tag(r, URING_ACCEPT));
+        } else {
+            r->accept_channel.fd = r->server_socket;
+            r->accept_channel.callback = [this, r](uint32_t) { handle_accept(r); };
+            r->loop.add(&r->accept_channel, EPOLLIN | EPOLLET);
+        }
+        reactors.push_back(move(reactor));
+    }
+
+    // The loops are not running yet, so this thread may set up their clients
+    for (size_t i = 0; i < handed.size(); i++) {
+        adopt_client(reactors[i % reactors.size()].get(), handed[i].first, handed[i].second);
+    }
+    if (link != -1) {
+        char ack = 1;
+        send(link, &ack, 1, MSG_NOSIGNAL);
+        close(link);
+        shared_print("从旧进程接管了 " + to_string(handed.size()) + " 个连接");
+    }
+
+    cout << colors[NUM_COLORS - 1] << "\n\t  ====== 欢迎加入聊天室 ======   " << endl << def_col;
+    logger.start();
+
+    for (auto& reactor : reactors) {
+        Reactor* r = reactor.get();
+        r->th = thread([r] { r->loop.loop(); });
+    }
+
+    // Scrapes and handoffs get their own thread, so they never delay a
+    // reactor; a successor inherits the metrics listener with the rest
+    if (metrics_port > 0 && metrics_socket == -1) {
+        metrics_socket = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int reuse = 1;
+        setsockopt(metrics_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(metrics_port);
+        addr.sin_addr.s_addr = INADDR_ANY;
+        if (bind(metrics_socket, (sockaddr*)&addr, sizeof(addr)) == -1 || listen(metrics_socket, 16) == -1) {
+            perror("metrics listener: ");
+            close(metrics_socket);
+            metrics_socket = -1;
+        }
+    }
+    if (!handoff_path.empty() && (handoff_socket = Handoff::listen(handoff_path)) == -1) {
+        perror("handoff listener: ");
+    }
+    if (metrics_socket != -1 || handoff_socket != -1) {
+        admin_th = thread(&ChatServer::serve_admin, this);
+    }
+
+    for (auto& reactor : reactors) {
+        if (reactor->th.joinable())
+            reactor->th.join();
+        if (reactor->uring) {
+            reactor->loop.remove(&reactor->uring_channel);
+        } else if (!reactor->frozen) {
+            reactor->loop.remove(&reactor->accept_channel);
+        }
+        close(reactor->server_socket);
+        // After a handoff only our copies go; the successor keeps the sockets
+        if (handed_off) {
+            for (auto& entry : reactor->clients) {
+                close(entry.second->socket);
+            }
+        }
+    }
+    stopping = true;
+    if (admin_th.joinable()) {
+        admin_th.join();
+    }
+    if (metrics_socket != -1) {
+        close(metrics_socket);
+    }
+    if (handoff_socket != -1) {
+        close(handoff_socket);
+        // The path belongs to the successor now
+        if (!handed_off) {
+            unlink(handoff_path.c_str());
+        }
+    }
+    logger.stop();
+}
+
+// Method to open a SO_REUSEPORT listening socket for one reactor
+int ChatServer::open_listener() {
+    int server_socket;
+
     // Initialize socket
-    if ((server_socket = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
+    if ((server_socket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1) {
         perror("socket: ");
         exit(EXIT_FAILURE);
     }
 
+    int reuse = 1;
+    setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (setsockopt(server_socket, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) == -1) {
+        perror("setsockopt SO_REUSEPORT: ");
+        close(server_socket);
+        exit(EXIT_FAILURE);
+    }
+
     // Configure server address
     sockaddr_in server;
     server.sin_family = AF_INET;
@@ -33,35 +366,349 @@ void ChatServer::start() {
     }
 
     // Listen for connections
-    if (listen(server_socket, 8) == -1) {
+    if (listen(server_socket, SOMAXCONN) == -1) {
         perror("listen error: ");
         close(server_socket);
         exit(EXIT_FAILURE);
     }
+    return server_socket;
+}
 
-    cout << colors[NUM_COLORS - 1] << "\n\t  ====== 欢迎加入聊天室 ======   " << endl << def_col;
+// Method to answer scrapes and handoff requests until stopping is set
+void ChatServer::serve_admin() {
+    while (!stopping) {
+        // Negative descriptors are ignored, so either listener may be off
+        pollfd fds[2] = {{metrics_socket, POLLIN, 0}, {handoff_socket, POLLIN, 0}};
+        if (poll(fds, 2, 200) <= 0) {
+            continue;
+        }
+        if (fds[0].revents & POLLIN) {
+            int client = accept4(metrics_socket, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client != -1) {
+                answer_scrape(client);
+            }
+        }
+        if (fds[1].revents & POLLIN) {
+            int link = accept4(handoff_socket, nullptr, nullptr, SOCK_CLOEXEC);
+            if (link != -1) {
+                bool done = hand_off(link);
+                close(link);
+                if (done) {
+                    return;
+                }
+            }
+        }
+    }
+}
 
-    sockaddr_in client;
-    unsigned int len = sizeof(sockaddr_in);
-    int client_socket;
+// Method to answer one HTTP request on the metrics listener
+void ChatServer::answer_scrape(int client) {
+    // A stalled scraper only holds up the next scrape
+    timeval timeout = {1, 0};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    string request;
+    char buf[1024];
+    while (request.find("\r\n\r\n") == string::npos && request.size() < 8192) {
+        ssize_t n = recv(client, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            break;
+        }
+        request.append(buf, n);
+    }
+
+    string body;
+    string status = "404 Not Found";
+    if (request.compare(0, 13, "GET /metrics ") == 0) {
+        body = metrics_text();
+        status = "200 OK";
+    }
+    string response = "HTTP/1.1 " + status + "\r\nContent-Type: text/plain; version=0.0.4\r\n" +
+                      "Content-Length: " + to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+    size_t done = 0;
+    while (done < response.size()) {
+        ssize_t n = send(client, response.data() + done, response.size() - done, MSG_NOSIGNAL);
+        if (n <= 0) {
+            break;
+        }
+        done += n;
+    }
+    close(client);
+}
+
+// Method to run a functor on a reactor's loop thread and wait for it
+void ChatServer::run_and_wait(Reactor* reactor, const function<void()>& functor) {
+    promise<void> done;
+    reactor->loop.run_in_loop([&functor, &done] {
+        functor();
+        done.set_value();
+    });
+    done.get_future().wait();
+}
+
+// Method to pass listeners and clients to a successor on link
+bool ChatServer::hand_off(int link) {
+    // Every reactor stops before any client is written out, so no broadcast
+    // is still on its way from one reactor to another
+    for (auto& reactor : reactors) {
+        Reactor* r = reactor.get();
+        run_and_wait(r, [this, r] { freeze(r); });
+    }
+    // io_uring: the cancelled requests complete asynchronously
+    for (auto& reactor : reactors) {
+        Reactor* r = reactor.get();
+        bool done = false;
+        while (true) {
+            run_and_wait(r, [this, r, &done] { done = quiet(r); });
+            if (done) {
+                break;
+            }
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+    }
+
+    bool ok = true;
+    for (auto& reactor : reactors) {
+        ok = ok && Handoff::send(link, RecordWriter(Handoff::LISTENER).data, reactor->server_socket);
+    }
+    if (metrics_socket != -1) {
+        ok = ok && Handoff::send(link, RecordWriter(Handoff::METRICS).data, metrics_socket);
+    }
+    size_t count = 0;
+    for (auto& reactor : reactors) {
+        Reactor* r = reactor.get();
+        vector<pair<string, int>> records;
+        run_and_wait(r, [this, r, &records] { save_clients(r, records); });
+        for (size_t i = 0; ok && i < records.size(); i++) {
+            ok = Handoff::send(link, records[i].first, records[i].second);
+        }
+        count += records.size();
+    }
+    {
+        lock_guard<mutex> guard(history_mtx);
+        for (auto& entry : histories) {
+            RecordWriter record(Handoff::HISTORY);
+            record.put_string(entry.first);
+            record.put_u32(static_cast<uint32_t>(entry.second.frames.size()));
+            for (size_t i = 0; i < entry.second.frames.size(); i++) {
+                const SharedFrame& frame = entry.second.frames[i];
+                record.put_string(string(frame.data(), frame.size()));
+            }
+            ok = ok && Handoff::send(link, record.data);
+        }
+    }
+    RecordWriter done(Handoff::DONE);
+    done.put_u32(static_cast<uint32_t>(seed.load()));
+    ok = ok && Handoff::send(link, done.data);
+
+    // The successor answers once it owns everything; until then we do
+    timeval timeout = {10, 0};
+    setsockopt(link, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    char ack = 0;
+    if (ok && recv(link, &ack, 1, 0) == 1) {
+        shared_print("已把 " + to_string(count) + " 个连接交给新进程");
+        handed_off = true;
+        for (auto& reactor : reactors) {
+            reactor->loop.quit();
+        }
+        return true;
+    }
+    shared_print("新进程接管失败, 继续服务", LOG_WARN);
+    for (auto& reactor : reactors) {
+        Reactor* r = reactor.get();
+        run_and_wait(r, [this, r] { thaw(r); });
+    }
+    return false;
+}
+
+// Method to stop a reactor accepting, reading and writing for a handoff
+void ChatServer::freeze(Reactor* reactor) {
+    reactor->frozen = true;
+    if (reactor->uring) {
+        // Receives that complete before the cancel only fill the decoder
+        reactor->uring->prep_cancel(uring_tag(reactor, URING_ACCEPT));
+        for (auto& entry : reactor->clients) {
+            Terminal* terminal = entry.second;
+            reactor->uring->prep_cancel(uring_tag(terminal, URING_RECV));
+            if (terminal->inflight_frames > 0) {
+                reactor->uring->prep_cancel(uring_tag(terminal, URING_SEND));
+            }
+        }
+        reactor->uring->submit();
+    } else {
+        reactor->accepting = false;
+        reactor->loop.remove(&reactor->accept_channel);
+        for (auto& entry : reactor->clients) {
+            reactor->loop.remove(&entry.second->channel);
+        }
+    }
+}
+
+// Method to check whether a frozen reactor has no I/O in flight
+bool ChatServer::quiet(Reactor* reactor) {
+    if (reactor->accepting) {
+        return false;
+    }
+    for (auto& entry : reactor->clients) {
+        if (entry.second->uring_ops > 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Method to write the state of a frozen reactor's clients as records
+void ChatServer::save_clients(Reactor* reactor, vector<pair<string, int>>& records) {
+    // Broadcasts posted before the freeze become queued output like the rest
+    drain_inbox(reactor);
+    for (auto& entry : reactor->clients) {
+        Terminal* terminal = entry.second;
+        RecordWriter record(Handoff::CLIENT);
+        record.put_u32(static_cast<uint32_t>(terminal->id));
+        record.put_u32(terminal->named ? 1 : 0);
+        record.put_string(terminal->name);
+        record.put_string(terminal->room);
+        record.put_string(terminal->decoder.pending());
+        // Whole frames plus how much of the first is out, so the successor
+        // resumes the byte stream exactly where it stopped
+        record.put_u32(static_cast<uint32_t>(terminal->out_offset));
+        record.put_u32(static_cast<uint32_t>(terminal->outq.size()));
+        for (size_t i = 0; i < terminal->outq.size(); i++) {
+            const SharedFrame& frame = terminal->outq[i].frame;
+            record.put_string(string(frame.data(), frame.size()));
+        }
+        records.push_back(make_pair(record.data, terminal->socket));
+    }
+}
 
+// Method to let a reactor serve its clients again after a failed handoff
+void ChatServer::thaw(Reactor* reactor) {
+    reactor->frozen = false;
+    reactor->accepting = true;
+    vector<Terminal*> terminals;
+    for (auto& entry : reactor->clients) {
+        terminals.push_back(entry.second);
+    }
+    if (reactor->uring) {
+        reactor->uring->prep_accept_multishot(reactor->server_socket, uring_tag(reactor, URING_ACCEPT));
+        for (Terminal* terminal : terminals) {
+            reactor->uring->prep_recv_multishot(terminal->socket, uring_tag(terminal, URING_RECV));
+            terminal->uring_ops++;
+        }
+        // Frames received while frozen are still in the decoders
+        for (Terminal* terminal : terminals) {
+            process_input(terminal, false);
+            if (terminal->socket != -1) {
+                flush(terminal);
+            }
+        }
+    } else {
+        // Edge-triggered registration reports what is already pending
+        reactor->loop.add(&reactor->accept_channel, EPOLLIN | EPOLLET);
+        for (Terminal* terminal : terminals) {
+            reactor->loop.add(&terminal->channel, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET);
+        }
+    }
+}
+
+// Method to read a predecessor's state from link; exits on a broken link
+void ChatServer::receive_handoff(int link, vector<int>& listeners, vector<pair<string, int>>& clients) {
+    string record;
+    int fd;
     while (true) {
-        if ((client_socket = accept(server_socket, (sockaddr*)&client, &len)) == -1) {
-            perror("accept error: ");
-            continue;
+        if (!Handoff::recv(link, record, fd)) {
+            cerr << "热重启: 与旧进程的连接中断" << endl;
+            exit(EXIT_FAILURE);
+        }
+        RecordReader in(record);
+        switch (in.type()) {
+        case Handoff::LISTENER:
+            listeners.push_back(fd);
+            break;
+        case Handoff::METRICS:
+            metrics_socket = fd;
+            break;
+        case Handoff::CLIENT:
+            clients.push_back(make_pair(record, fd));
+            break;
+        case Handoff::HISTORY: {
+            // Recorded again, so the limits of this binary apply
+            string room = in.get_string();
+            uint32_t frames = in.get_u32();
+            for (uint32_t i = 0; i < frames; i++) {
+                string bytes = in.get_string();
+                if (!in.ok) {
+                    break;
+                }
+                SharedFrame frame = SharedBuffer::allocate(bytes.size());
+                memcpy(frame.data(), bytes.data(), bytes.size());
+                remember(room, frame);
+            }
+            // Counted as empty until an adopted member joins the room again
+            if (room != DEFAULT_ROOM) {
+                lock_guard<mutex> guard(history_mtx);
+                auto history = histories.find(room);
+                if (history != histories.end()) {
+                    history->second.emptied_ns = now_ns();
+                }
+            }
+            break;
+        }
+        case Handoff::DONE:
+            seed = static_cast<int>(in.get_u32());
+            return;
+        default:
+            if (fd != -1) {
+                close(fd);
+            }
+            break;
         }
-        seed++;
-        thread t(&ChatServer::handle_client, this, client_socket, seed);
-        lock_guard<mutex> guard(clients_mtx);
-        clients.push_back({seed, "Anonymous", client_socket, move(t)});
     }
+}
 
-    for (auto& client : clients) {
-        if (client.th.joinable())
-            client.th.join();
+// Method to rebuild a client passed on by the predecessor
+void ChatServer::adopt_client(Reactor* reactor, const string& record, int client_socket) {
+    RecordReader in(record);
+    int id = static_cast<int>(in.get_u32());
+    bool named = in.get_u32() != 0;
+    string name = in.get_string();
+    string room = in.get_string();
+    string input = in.get_string();
+    size_t out_offset = in.get_u32();
+    vector<string> frames(in.get_u32());
+    for (size_t i = 0; in.ok && i < frames.size(); i++) {
+        frames[i] = in.get_string();
+    }
+    if (!in.ok || client_socket == -1 || id <= 0) {
+        if (client_socket != -1) {
+            close(client_socket);
+        }
+        return;
     }
 
-    close(server_socket);
+    Terminal* terminal = add_client(reactor, client_socket, id);
+    terminal->named = named;
+    terminal->name = name;
+    if (named) {
+        registry.insert(id, ClientInfo{name, reactor});
+        join_room(terminal, room);
+        arm_heartbeat(terminal);
+    }
+    terminal->decoder.feed(input.data(), input.size());
+    for (const string& bytes : frames) {
+        SharedFrame frame = SharedBuffer::allocate(bytes.size());
+        memcpy(frame.data(), bytes.data(), bytes.size());
+        terminal->outq.push_back(OutFrame{frame, 0, now_ns()});
+        terminal->out_bytes += bytes.size();
+        reactor->queued_bytes.fetch_add(bytes.size(), memory_order_relaxed);
+    }
+    terminal->out_offset = frames.empty() ? 0 : out_offset;
+    reactor->loop.add_timer(&terminal->flusher, 0);
+    // Complete frames that the predecessor had not handled yet
+    if (!input.empty()) {
+        reactor->loop.queue_in_loop([this, terminal] { process_input(terminal, false); });
+    }
 }
 
 // Method to get color code based on client ID
@@ -70,88 +717,802 @@ string ChatServer::color(int code) {
 }
 
 // Method to set the name of a client
-void ChatServer::set_name(int id, const char* name) {
-    lock_guard<mutex> guard(clients_mtx);
-    for (auto& client : clients) {
-        if (client.id == id) {
-            client.name = name;
-            break;
+void ChatServer::set_name(Terminal* terminal, const char* name) {
+    terminal->name = name;
+}
+
+// Thread-safe method to print shared messages without waiting on I/O
+void ChatServer::shared_print(const string& str, LogLevel level) {
+    logger.log(level, str);
+}
+
+// Method to broadcast a frame to a room, except to the sender
+void ChatServer::broadcast_message(const string& room, uint8_t type, int sender_id,
+                                   const string& name, const string& payload, uint64_t received) {
+    // Encoded once; every recipient queues a reference to the same bytes,
+    // and chat messages keep one in the room's history
+    SharedFrame frame = make_frame(type, sender_id, name, payload);
+    uint64_t seq = type == FRAME_CHAT ? remember(room, frame) : 0;
+    broadcast_bytes(room, frame, sender_id, received, seq);
+}
+
+// Method to hand an encoded frame to every reactor for delivery
+void ChatServer::broadcast_bytes(const string& room, const SharedFrame& frame, int sender_id, uint64_t received,
+                                 uint64_t seq) {
+    // The sender's own reactor delivers inline; the others get an inbox
+    // entry, which keeps every client's byte stream in the order it was
+    // broadcast
+    for (auto& reactor : reactors) {
+        Reactor* r = reactor.get();
+        if (r->loop.in_loop_thread()) {
+            deliver(r, room, frame, sender_id, received, seq);
+        } else {
+            post(r, room, frame, sender_id, received, seq);
+        }
+    }
+}
+
+// Method to queue a broadcast in another reactor's inbox
+void ChatServer::post(Reactor* reactor, const string& room, const SharedFrame& frame, int sender_id,
+                      uint64_t received, uint64_t seq) {
+    // Entries are overwritten in place rather than created, so their room
+    // strings keep their capacity; only the first entry of a batch queues
+    // the drain, whose two-pointer capture std::function stores inline
+    bool first;
+    {
+        lock_guard<mutex> guard(reactor->inbox_mtx);
+        if (reactor->inbox_count == reactor->inbox.size()) {
+            reactor->inbox.emplace_back();
         }
+        Delivery& delivery = reactor->inbox[reactor->inbox_count++];
+        delivery.frame = frame;
+        delivery.sender_id = sender_id;
+        delivery.received = received;
+        delivery.seq = seq;
+        delivery.room = room;
+        first = reactor->inbox_count == 1;
+    }
+    if (first) {
+        reactor->loop.queue_in_loop([this, reactor] { drain_inbox(reactor); });
     }
 }
 
-// Thread-safe method to print shared messages
-void ChatServer::shared_print(const string& str, bool endLine) {
-    lock_guard<mutex> guard(cout_mtx);
-    cout << str;
-    if (endLine) {
-        cout << endl;
+// Method to deliver every broadcast waiting in a reactor's inbox
+void ChatServer::drain_inbox(Reactor* reactor) {
+    AllocScope scope(reactor->allocations);
+    size_t count;
+    {
+        lock_guard<mutex> guard(reactor->inbox_mtx);
+        reactor->inbox.swap(reactor->inbox_work);
+        count = reactor->inbox_count;
+        reactor->inbox_count = 0;
+    }
+    for (size_t i = 0; i < count; i++) {
+        Delivery& delivery = reactor->inbox_work[i];
+        deliver(reactor, delivery.room, delivery.frame, delivery.sender_id, delivery.received, delivery.seq);
+        delivery.frame.reset();
     }
 }
 
-// Method to broadcast message to all clients except the sender
-void ChatServer::broadcast_message(const string& message, int sender_id) {
-    lock_guard<mutex> guard(clients_mtx);
-    for (const auto& client : clients) {
-        if (client.id != sender_id) {
-            send(client.socket, message.c_str(), message.length() + 1, 0);
+// Method to deliver an encoded frame to a room's members on one reactor
+void ChatServer::deliver(Reactor* reactor, const string& room, const SharedFrame& frame, int sender_id,
+                         uint64_t received, uint64_t seq) {
+    // Runs on the reactor's own thread, so its room index needs no lock
+    auto it = reactor->rooms.find(room);
+    if (it == reactor->rooms.end()) {
+        return;
+    }
+    // A member who joined after the frame was recorded, but before this
+    // delivery reached the reactor, already has it from the replay
+    for (Terminal* member : it->second) {
+        if (member->id != sender_id && (seq == 0 || seq > member->history_seq)) {
+            queue_send(member, frame, received);
         }
     }
 }
 
-// Method to broadcast a number to all clients except the sender
-void ChatServer::broadcast_message(int num, int sender_id) {
-    lock_guard<mutex> guard(clients_mtx);
-    for (const auto& client : clients) {
-        if (client.id != sender_id) {
-            send(client.socket, &num, sizeof(num), 0);
+// Method to add a chat frame to a room's history
+uint64_t ChatServer::remember(const string& room, const SharedFrame& frame) {
+    if (history_limits.max_frames == 0) {
+        return 0;
+    }
+    // The ring holds references, so recording a message copies no bytes
+    lock_guard<mutex> guard(history_mtx);
+    auto it = histories.find(room);
+    if (it == histories.end()) {
+        it = histories.emplace(room, RoomHistory()).first;
+    }
+    RoomHistory& history = it->second;
+    history.frames.push_back(frame);
+    history.bytes += frame.size();
+    while (history.frames.size() > history_limits.max_frames ||
+           (history.bytes > history_limits.max_bytes && history.frames.size() > 1)) {
+        history.bytes -= history.frames.front().size();
+        history.frames.pop_front();
+    }
+    return ++history_seq;
+}
+
+// Method to queue a room's history to a client that just joined it
+void ChatServer::replay_history(Terminal* terminal) {
+    vector<SharedFrame>& replay = terminal->reactor->replay;
+    {
+        lock_guard<mutex> guard(history_mtx);
+        // Everything recorded up to now is in the replay or too old to keep;
+        // deliver() skips the broadcasts of those still on their way
+        terminal->history_seq = history_seq;
+        auto it = histories.find(terminal->room);
+        if (it != histories.end()) {
+            for (size_t i = 0; i < it->second.frames.size(); i++) {
+                replay.push_back(it->second.frames[i]);
+            }
         }
     }
+    // Queued back to back, so they leave in as few sendmsg calls as the
+    // iovec limit allows, normally one
+    for (SharedFrame& frame : replay) {
+        queue_send(terminal, frame);
+    }
+    replay.clear();
+}
+
+// Method to move a client into a room, leaving its current one
+void ChatServer::join_room(Terminal* terminal, const string& room) {
+    leave_room(terminal);
+    vector<Terminal*>& members = terminal->reactor->rooms[room];
+    terminal->room = room;
+    terminal->room_pos = members.size();
+    members.push_back(terminal);
+
+    lock_guard<mutex> guard(rooms_mtx);
+    if (room_sizes[room]++ == 0) {
+        lock_guard<mutex> history_guard(history_mtx);
+        auto history = histories.find(room);
+        if (history != histories.end()) {
+            history->second.emptied_ns = 0;
+        }
+    }
+}
+
+// Method to take a client out of its current room
+void ChatServer::leave_room(Terminal* terminal) {
+    if (terminal->room.empty()) {
+        return;
+    }
+    // Swap with the last member so removal is O(1)
+    auto it = terminal->reactor->rooms.find(terminal->room);
+    vector<Terminal*>& members = it->second;
+    Terminal* last = members.back();
+    members[terminal->room_pos] = last;
+    last->room_pos = terminal->room_pos;
+    members.pop_back();
+    if (members.empty()) {
+        terminal->reactor->rooms.erase(it);
+    }
+
+    {
+        lock_guard<mutex> guard(rooms_mtx);
+        if (--room_sizes[terminal->room] == 0) {
+            room_sizes.erase(terminal->room);
+            // The history outlives the members, so whoever comes back still
+            // sees what was said; the lobby keeps it for good, other rooms
+            // until they have been empty for HISTORY_KEEP_SECONDS
+            lock_guard<mutex> history_guard(history_mtx);
+            uint64_t now = now_ns();
+            auto history = histories.find(terminal->room);
+            if (history != histories.end() && terminal->room != DEFAULT_ROOM) {
+                history->second.emptied_ns = now;
+            }
+            for (auto entry = histories.begin(); entry != histories.end();) {
+                uint64_t emptied = entry->second.emptied_ns;
+                if (emptied != 0 && now - emptied >= HISTORY_KEEP_SECONDS * 1000000000ULL) {
+                    entry = histories.erase(entry);
+                } else {
+                    ++entry;
+                }
+            }
+        }
+    }
+    terminal->room.clear();
+}
+
+// Method to run a client's liveness timer
+void ChatServer::check_liveness(Terminal* terminal) {
+    Reactor* reactor = terminal->reactor;
+    // Mid-handoff the successor takes over the checks
+    if (reactor->frozen) {
+        arm_heartbeat(terminal);
+        return;
+    }
+    uint64_t silent = reactor->loop.now() - terminal->last_recv;
+    if (!terminal->named || (timeouts.idle > 0 && silent >= timeouts.idle * 1000ull)) {
+        reactor->timed_out.fetch_add(1, memory_order_relaxed);
+        shared_print(color(terminal->id) + terminal->name + (terminal->named ? " 超时断开" : " 未发送名字, 断开") +
+                     def_col, LOG_DEBUG);
+        end_connection(reactor, terminal->id);
+        return;
+    }
+    if (timeouts.heartbeat > 0 && silent >= timeouts.heartbeat * 1000ull) {
+        queue_send(terminal, ping);
+    }
+    arm_heartbeat(terminal);
+}
+
+// Method to schedule a client's next liveness check after the handshake
+void ChatServer::arm_heartbeat(Terminal* terminal) {
+    // Every client gets one check per interval whatever it sends; its reads
+    // only move last_recv, so busy clients never touch the wheel
+    int interval = timeouts.heartbeat > 0 ? timeouts.heartbeat : timeouts.idle;
+    if (interval > 0) {
+        terminal->reactor->loop.add_timer(&terminal->liveness, interval * 1000ull);
+    } else {
+        terminal->reactor->loop.cancel_timer(&terminal->liveness);
+    }
+}
+
+// Method to send one frame to a single client
+void ChatServer::send_to(Terminal* terminal, uint8_t type, const string& payload) {
+    queue_send(terminal, make_frame(type, 0, "", payload));
 }
 
 // Method to end the connection with a client
-void ChatServer::end_connection(int id) {
-    lock_guard<mutex> guard(clients_mtx);
-    auto it = find_if(clients.begin(), clients.end(), [id](const Terminal& client) {
-        return client.id == id;
-    });
-    if (it != clients.end()) {
-        it->th.detach();
-        close(it->socket);
-        clients.erase(it);
+void ChatServer::end_connection(Reactor* reactor, int id) {
+    // A frozen reactor's sockets may already belong to the successor
+    if (reactor->frozen) {
+        return;
+    }
+    auto it = reactor->clients.find(id);
+    if (it != reactor->clients.end()) {
+        reactor->closed.fetch_add(1, memory_order_relaxed);
+        registry.remove(id);
+        Terminal* terminal = it->second;
+        leave_room(terminal);
+        reactor->clients.erase(it);
+        reactor->loop.cancel_timer(&terminal->liveness);
+        reactor->loop.cancel_timer(&terminal->flusher);
+        reactor->loop.cancel_timer(&terminal->overflow);
+        if (reactor->uring) {
+            // Hand over queued output first; the shutdown then ends the
+            // multishot recv, whose completion comes back with 0
+            reactor->uring->submit();
+            shutdown(terminal->socket, SHUT_RDWR);
+        } else {
+            reactor->loop.remove(&terminal->channel);
+        }
+        terminal->socket = -1;
+        release_terminal(terminal);
     }
 }
 
-// Method to handle client communication
-void ChatServer::handle_client(int client_socket, int id) {
-    char name[MAX_LEN], str[MAX_LEN];
-    recv(client_socket, name, sizeof(name), 0);
-    set_name(id, name);
+// Method to close a client's socket and free it once no I/O refers to it
+void ChatServer::release_terminal(Terminal* terminal) {
+    // channel.fd still holds the descriptor; -1 there marks it released
+    if (terminal->uring_ops > 0 || terminal->channel.fd == -1) {
+        return;
+    }
+    close(terminal->channel.fd);
+    terminal->channel.fd = -1;
+    terminal->reactor->queued_bytes.fetch_sub(terminal->out_bytes, memory_order_relaxed);
+    terminal->outq.clear();
+    terminal->out_offset = 0;
+    terminal->out_bytes = 0;
+    // Events for this socket may still be queued in the current batch
+    Reactor* reactor = terminal->reactor;
+    reactor->loop.queue_in_loop([reactor, terminal] { reactor->terminals.release(terminal); });
+}
 
-    string welcome_message = string(name) + " 加入";
-    broadcast_message("#NULL", id);
-    broadcast_message(id, id);
-    broadcast_message(welcome_message, id);
-    shared_print(color(id) + welcome_message + def_col);
+// Method to accept every pending connection on a reactor's listener
+void ChatServer::handle_accept(Reactor* reactor) {
+    sockaddr_in client;
+    socklen_t len = sizeof(sockaddr_in);
+    int client_socket;
 
     while (true) {
-        int bytes_received = recv(client_socket, str, sizeof(str), 0);
-        if (bytes_received <= 0) {
-            break;
+        client_socket = accept4(reactor->server_socket, (sockaddr*)&client, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_socket == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("accept error: ");
+            }
+            return;
+        }
+        add_client(reactor, client_socket);
+    }
+}
+
+// Method to set up state for a freshly accepted client socket
+ChatServer::Terminal* ChatServer::add_client(Reactor* reactor, int client_socket, int id) {
+    if (id == 0) {
+        id = ++seed;
+    }
+    // A recycled terminal keeps its buffers; every field is set again here
+    Terminal* terminal = reactor->terminals.acquire();
+    reactor->accepted.fetch_add(1, memory_order_relaxed);
+    terminal->id = id;
+    terminal->name = "Anonymous";
+    terminal->socket = client_socket;
+    terminal->named = false;
+    terminal->decoder.reset(max_message_size);
+    terminal->out_offset = 0;
+    terminal->out_bytes = 0;
+    terminal->over_limit = false;
+    terminal->reactor = reactor;
+    terminal->uring_ops = 0;
+    terminal->inflight_frames = 0;
+    terminal->channel.fd = client_socket;
+    terminal->channel.callback = [this, terminal](uint32_t events) { handle_event(terminal, events); };
+    terminal->liveness.callback = [this, terminal] { check_liveness(terminal); };
+    terminal->flusher.callback = [this, terminal] { flush(terminal); };
+    terminal->overflow.callback = [this, terminal] { check_overflow(terminal); };
+    terminal->last_recv = reactor->loop.now();
+    terminal->history_seq = 0;
+    if (timeouts.handshake > 0) {
+        reactor->loop.add_timer(&terminal->liveness, timeouts.handshake * 1000ull);
+    }
+    // Output is already coalesced per loop round, so Nagle would only add
+    // a round trip of delay to every broadcast
+    int one = 1;
+    setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    reactor->clients[id] = terminal;
+    if (reactor->frozen) {
+        // Accepted while handing off: armed by thaw() or by the successor
+    } else if (reactor->uring) {
+        reactor->uring->prep_recv_multishot(client_socket, uring_tag(terminal, URING_RECV));
+        terminal->uring_ops++;
+    } else {
+        reactor->loop.add(&terminal->channel, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET);
+    }
+    return terminal;
+}
+
+// Method to dispatch readiness events of a client socket
+void ChatServer::handle_event(Terminal* terminal, uint32_t events) {
+    if (terminal->socket == -1) {
+        return;
+    }
+    AllocScope scope(terminal->reactor->allocations);
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        handle_read(terminal);
+    }
+    if (terminal->socket != -1 && (events & EPOLLOUT)) {
+        flush(terminal);
+    }
+}
+
+// Method to drain a client socket and process complete frames
+void ChatServer::handle_read(Terminal* terminal) {
+    char buf[4096];
+    bool peer_closed = false;
+
+    // Edge-triggered: keep reading until the kernel buffer is empty.
+    // Frames are handled after every chunk so the decoder stays small; after
+    // a malformed frame the rest is read and dropped, so the close below
+    // sends the error notice instead of a reset
+    while (true) {
+        ssize_t n = recv(terminal->socket, buf, sizeof(buf), 0);
+        if (n > 0) {
+            terminal->reactor->bytes_in.fetch_add(n, memory_order_relaxed);
+            terminal->last_recv = terminal->reactor->loop.now();
+            if (!terminal->decoder.error()) {
+                terminal->reactor->recv_time = now_ns();
+                terminal->decoder.feed(buf, n);
+                process_frames(terminal);
+                if (terminal->socket == -1) {
+                    return;
+                }
+            }
+            continue;
+        }
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            peer_closed = true;
+        }
+        break;
+    }
+    process_input(terminal, peer_closed);
+}
+
+// Method to handle every complete frame buffered for a client
+void ChatServer::process_input(Terminal* terminal, bool peer_closed) {
+    process_frames(terminal);
+    if (terminal->socket == -1) {
+        return;
+    }
+
+    if (terminal->decoder.too_large()) {
+        send_to(terminal, FRAME_SYSTEM, "消息过长, 上限 " + to_string(max_message_size) + " 字节");
+        flush(terminal);
+    }
+    if (terminal->decoder.error()) {
+        terminal->reactor->errors.fetch_add(1, memory_order_relaxed);
+    }
+    if (peer_closed || terminal->decoder.error()) {
+        end_connection(terminal->reactor, terminal->id);
+    }
+}
+
+// Method to handle the complete frames buffered for a client until it closes
+void ChatServer::process_frames(Terminal* terminal) {
+    Reactor* reactor = terminal->reactor;
+    Frame& frame = reactor->frame;
+    while (terminal->socket != -1 && terminal->decoder.next(frame)) {
+        reactor->latency.parse.record(now_ns() - reactor->recv_time);
+        handle_frame(terminal, frame);
+    }
+}
+
+// Method to handle one frame received from a client
+void ChatServer::handle_frame(Terminal* terminal, const Frame& frame) {
+    int id = terminal->id;
+
+    if (!terminal->named) {
+        if (frame.type != FRAME_HELLO) {
+            return;
         }
-        if (strcmp(str, "#exit") == 0) {
-            string message = string(name) + " 离开";
-            broadcast_message("#NULL", id);
-            broadcast_message(id, id);
-            broadcast_message(message, id);
-            shared_print(color(id) + message + def_col);
-            end_connection(id);
+        terminal->named = true;
+        set_name(terminal, frame.name.c_str());
+        registry.insert(id, ClientInfo{terminal->name, terminal->reactor});
+        join_room(terminal, DEFAULT_ROOM);
+        replay_history(terminal);
+        arm_heartbeat(terminal);
+
+        string welcome_message = terminal->name + " 加入";
+        broadcast_message(terminal->room, FRAME_SYSTEM, id, terminal->name, welcome_message);
+        shared_print(color(id) + welcome_message + def_col);
+        return;
+    }
+    if (frame.type != FRAME_CHAT) {
+        return;
+    }
+    if (handle_command(terminal, frame.payload)) {
+        return;
+    }
+
+    const string& name = terminal->name;
+    Reactor* reactor = terminal->reactor;
+    reactor->messages.fetch_add(1, memory_order_relaxed);
+    uint64_t parsed = now_ns();
+    broadcast_message(terminal->room, FRAME_CHAT, id, name, frame.payload, reactor->recv_time);
+    reactor->latency.fanout.record(now_ns() - parsed);
+
+    // Built in a reused string; concatenating temporaries would allocate
+    string& line = reactor->log_line;
+    line.assign(colors[id % NUM_COLORS]);
+    line += "[";
+    line += terminal->room;
+    line += "] ";
+    line += name;
+    line += " : ";
+    line += def_col;
+    line += frame.payload;
+    shared_print(line);
+}
+
+// Method to handle a "#..." command; false if the text is a chat message
+bool ChatServer::handle_command(Terminal* terminal, const string& text) {
+    int id = terminal->id;
+    const string& name = terminal->name;
+
+    if (text == "#exit") {
+        string message = name + " 离开";
+        broadcast_message(terminal->room, FRAME_SYSTEM, id, name, message);
+        shared_print(color(id) + message + def_col);
+        end_connection(terminal->reactor, id);
+        return true;
+    }
+    if (text == "#users") {
+        // Lock-free walk of the directory; other reactors keep running
+        string users = "在线用户 :";
+        registry.for_each([&users](int, const ClientInfo& info) {
+            users += " " + info.name;
+        });
+        send_to(terminal, FRAME_SYSTEM, users);
+        return true;
+    }
+    if (text == "#rooms") {
+        string list = "房间 :";
+        {
+            lock_guard<mutex> guard(rooms_mtx);
+            for (const auto& entry : room_sizes) {
+                list += " " + entry.first + "(" + to_string(entry.second) + ")";
+            }
+        }
+        send_to(terminal, FRAME_SYSTEM, list);
+        return true;
+    }
+    if (text == "#latency") {
+        LatencyStats stats;
+        latency_stats(stats);
+        send_to(terminal, FRAME_SYSTEM, "延迟 p50/p99/p999 (us) : 解析 " + percentiles(stats.parse) +
+                                        ", 扇出 " + percentiles(stats.fanout) +
+                                        ", 排队 " + percentiles(stats.queue_wait) +
+                                        ", 收到->发出 " + percentiles(stats.recv_to_send));
+        return true;
+    }
+    if (text.compare(0, 6, "#join ") == 0 || text == "#leave") {
+        string room = text == "#leave" ? string(DEFAULT_ROOM) : text.substr(6);
+        if (room.empty() || room == terminal->room) {
+            send_to(terminal, FRAME_SYSTEM, "已在房间 " + terminal->room);
+            return true;
+        }
+        string old_room = terminal->room;
+        broadcast_message(old_room, FRAME_SYSTEM, id, name, name + " 离开 " + old_room);
+        join_room(terminal, room);
+        broadcast_message(room, FRAME_SYSTEM, id, name, name + " 加入 " + room);
+        send_to(terminal, FRAME_SYSTEM, "已进入房间 " + room);
+        replay_history(terminal);
+        shared_print(color(id) + name + " : " + old_room + " -> " + room + def_col);
+        return true;
+    }
+    return false;
+}
+
+// Method to queue a frame for a client without copying it
+void ChatServer::queue_send(Terminal* terminal, const SharedFrame& frame, uint64_t received) {
+    bool idle = terminal->outq.empty();
+    bool over = terminal->out_bytes >= limits.max_bytes || terminal->outq.size() >= limits.max_frames;
+    if (over && limits.policy == DROP_CHAT && frame_type(frame.data()) == FRAME_CHAT) {
+        dropped_chat++;
+        return;
+    }
+    terminal->outq.push_back(OutFrame{frame, received, now_ns()});
+    terminal->out_bytes += frame.size();
+    terminal->reactor->queued_bytes.fetch_add(frame.size(), memory_order_relaxed);
+    // A full sendmsg worth goes out now; a long burst read in one round
+    // must not pile up against the limits before the deferred flush runs
+    if (terminal->flusher.pending() && (terminal->outq.size() >= MAX_IOV || terminal->out_bytes >= FLUSH_BYTES)) {
+        flush(terminal);
+    }
+    if (terminal->out_bytes > limits.max_bytes || terminal->outq.size() > limits.max_frames) {
+        handle_overflow(terminal);
+    }
+    // Flushed once at the end of the loop round, so everything queued for
+    // the client meanwhile goes out in one sendmsg. A non-empty queue means
+    // that flush is already due or the socket is full and EPOLLOUT will
+    // flush it
+    if (idle) {
+        terminal->reactor->loop.add_timer(&terminal->flusher, 0);
+    }
+}
+
+// Method to apply the overflow policy to a client past its mark
+void ChatServer::handle_overflow(Terminal* terminal) {
+    switch (limits.policy) {
+    case DROP_OLDEST: {
+        // The head frame may be half written and frames handed to io_uring
+        // are still being read by the kernel; both must stay
+        size_t keep = max(terminal->inflight_frames, static_cast<size_t>(terminal->out_offset > 0 ? 1 : 0));
+        size_t drop = 0;
+        size_t bytes_before = terminal->out_bytes;
+        while (keep + drop < terminal->outq.size() - 1 &&
+               (terminal->out_bytes > limits.max_bytes || terminal->outq.size() - drop > limits.max_frames)) {
+            terminal->out_bytes -= terminal->outq[keep + drop].frame.size();
+            drop++;
+        }
+        terminal->outq.erase(keep, drop);
+        terminal->reactor->queued_bytes.fetch_sub(bytes_before - terminal->out_bytes, memory_order_relaxed);
+        dropped_oldest += drop;
+        break;
+    }
+    case DROP_CHAT:
+        // Only system notices get past the mark; they are rare and small
+        break;
+    case DISCONNECT:
+        // The deadline runs on the wheel, so a client that stays over the
+        // mark is closed even if nothing more is queued for it
+        if (!terminal->over_limit) {
+            terminal->over_limit = true;
+            terminal->reactor->loop.add_timer(&terminal->overflow, limits.grace_seconds * 1000ull);
+        }
+        break;
+    }
+}
+
+// Method to run a client's overflow deadline
+void ChatServer::check_overflow(Terminal* terminal) {
+    Reactor* reactor = terminal->reactor;
+    if (!terminal->over_limit) {
+        return;
+    }
+    // Mid-handoff the sockets may belong to the successor; look again later
+    if (reactor->frozen) {
+        reactor->loop.add_timer(&terminal->overflow, limits.grace_seconds * 1000ull);
+        return;
+    }
+    disconnected++;
+    end_connection(reactor, terminal->id);
+}
+
+// Method to write as much of a client's pending output as possible
+void ChatServer::flush(Terminal* terminal) {
+    // Output queued while frozen is passed on to the successor
+    if (terminal->reactor->frozen) {
+        return;
+    }
+    if (terminal->reactor->uring) {
+        uring_flush(terminal);
+        return;
+    }
+    iovec iov[MAX_IOV];
+
+    while (!terminal->outq.empty()) {
+        // Gather queued frames into one sendmsg; unlike writev it can be told
+        // not to raise SIGPIPE when the peer has gone
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = gather_output(terminal, iov, MAX_IOV);
+
+        ssize_t n = sendmsg(terminal->socket, &msg, MSG_NOSIGNAL);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;  // EPOLLOUT fires once the socket drains
+            }
+            // The peer is gone; close it outside of any broadcast in progress
+            Reactor* reactor = terminal->reactor;
+            int id = terminal->id;
+            reactor->errors.fetch_add(1, memory_order_relaxed);
+            reactor->queued_bytes.fetch_sub(terminal->out_bytes, memory_order_relaxed);
+            terminal->outq.clear();
+            terminal->out_offset = 0;
+            terminal->out_bytes = 0;
+            reactor->loop.queue_in_loop([this, reactor, id] { end_connection(reactor, id); });
             return;
         }
-        broadcast_message(string(name), id);
-        broadcast_message(id, id);
-        broadcast_message(string(str), id);
-        shared_print(color(id) + name + " : " + def_col + str);
+        consume_output(terminal, n);
+    }
+}
+
+// Method to fill up to max entries of iov from a client's output queue
+int ChatServer::gather_output(Terminal* terminal, iovec* iov, int max) {
+    int count = 0;
+    for (size_t i = 0; i < terminal->outq.size() && count < max; i++) {
+        SharedFrame& frame = terminal->outq[i].frame;
+        size_t skip = count == 0 ? terminal->out_offset : 0;
+        iov[count].iov_base = frame.data() + skip;
+        iov[count].iov_len = frame.size() - skip;
+        count++;
+    }
+    return count;
+}
+
+// Method to release output the socket has accepted
+void ChatServer::consume_output(Terminal* terminal, size_t sent) {
+    // Release every frame that went out completely; its last byte was
+    // written now
+    uint64_t now = now_ns();
+    Reactor* reactor = terminal->reactor;
+    LatencyStats& latency = reactor->latency;
+    reactor->bytes_out.fetch_add(sent, memory_order_relaxed);
+    while (sent > 0) {
+        OutFrame& out = terminal->outq.front();
+        size_t left = out.frame.size() - terminal->out_offset;
+        if (sent < left) {
+            terminal->out_offset += sent;
+            break;
+        }
+        sent -= left;
+        latency.queue_wait.record(now - out.queued);
+        if (out.received != 0) {
+            latency.recv_to_send.record(now - out.received);
+        }
+        terminal->out_bytes -= out.frame.size();
+        reactor->queued_bytes.fetch_sub(out.frame.size(), memory_order_relaxed);
+        terminal->outq.pop_front();
+        terminal->out_offset = 0;
+    }
+    if (terminal->over_limit && terminal->out_bytes <= limits.max_bytes && terminal->outq.size() <= limits.max_frames) {
+        terminal->over_limit = false;
+        reactor->loop.cancel_timer(&terminal->overflow);
+    }
+}
+
+// Method to submit a client's queued output as one io_uring send
+void ChatServer::uring_flush(Terminal* terminal) {
+    // One send at a time keeps the byte stream in order; its completion
+    // submits whatever was queued meanwhile
+    if (terminal->inflight_frames > 0 || terminal->outq.empty() || terminal->socket == -1 ||
+        terminal->reactor->frozen) {
+        return;
+    }
+    // A backlog goes out in one large send; idle clients keep a short vector
+    size_t count = min(terminal->outq.size(), static_cast<size_t>(URING_MAX_IOV));
+    if (terminal->send_iov.size() < count) {
+        terminal->send_iov.resize(count);
+    }
+    memset(&terminal->send_msg, 0, sizeof(terminal->send_msg));
+    terminal->send_msg.msg_iov = terminal->send_iov.data();
+    terminal->send_msg.msg_iovlen = gather_output(terminal, terminal->send_iov.data(), count);
+    terminal->inflight_frames = count;
+    terminal->uring_ops++;
+    terminal->reactor->uring->prep_sendmsg(terminal->socket, &terminal->send_msg, uring_tag(terminal, URING_SEND));
+}
+
+// Method to handle every completion posted to a reactor's ring
+void ChatServer::handle_uring(Reactor* reactor) {
+    // Sends queued by these completions go out before the next batch; the
+    // ring fd stays readable while completions are left
+    reactor->uring->drain([this, reactor](const io_uring_cqe& cqe) { handle_completion(reactor, cqe); },
+                          URING_BATCH);
+}
+
+// Method to handle one io_uring completion
+void ChatServer::handle_completion(Reactor* reactor, const io_uring_cqe& cqe) {
+    int op = static_cast<int>(cqe.user_data & URING_OP_MASK);
+    void* ptr = reinterpret_cast<void*>(cqe.user_data & ~URING_OP_MASK);
+    bool more = cqe.flags & IORING_CQE_F_MORE;
+
+    if (op == URING_ACCEPT) {
+        if (cqe.res >= 0) {
+            add_client(reactor, cqe.res);
+        } else if (cqe.res != -EINTR && cqe.res != -ECONNABORTED) {
+            errno = -cqe.res;
+            perror("accept error: ");
+        }
+        if (!more) {
+            if (reactor->frozen) {
+                reactor->accepting = false;
+            } else {
+                reactor->uring->prep_accept_multishot(reactor->server_socket, uring_tag(reactor, URING_ACCEPT));
+            }
+        }
+        return;
+    }
+
+    Terminal* terminal = static_cast<Terminal*>(ptr);
+    AllocScope scope(reactor->allocations);
+    if (op == URING_RECV) {
+        bool peer_closed = false;
+        if (cqe.res > 0) {
+            uint16_t bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            reactor->bytes_in.fetch_add(cqe.res, memory_order_relaxed);
+            terminal->last_recv = reactor->loop.now();
+            if (terminal->socket != -1) {
+                reactor->recv_time = now_ns();
+                terminal->decoder.feed(reactor->uring->buffer(bid), cqe.res);
+            }
+            reactor->uring->recycle(bid);
+        } else if (cqe.res != -ENOBUFS && cqe.res != -ECANCELED) {
+            peer_closed = true;
+        }
+        if (!more) {
+            terminal->uring_ops--;
+            // Ended by the kernel (e.g. all buffers busy) rather than the peer
+            if (!peer_closed && terminal->socket != -1 && !reactor->frozen) {
+                reactor->uring->prep_recv_multishot(terminal->socket, uring_tag(terminal, URING_RECV));
+                terminal->uring_ops++;
+            }
+        }
+        // Frozen: the decoder keeps what came in for the successor
+        if (terminal->socket != -1 && !reactor->frozen) {
+            process_input(terminal, peer_closed);
+        }
+    } else {
+        terminal->uring_ops--;
+        terminal->inflight_frames = 0;
+        if (terminal->socket != -1) {
+            if (cqe.res >= 0 || cqe.res == -ECANCELED) {
+                // Only a handoff cancels sends; the rest goes to the successor
+                consume_output(terminal, cqe.res > 0 ? cqe.res : 0);
+                uring_flush(terminal);
+            } else {
+                reactor->errors.fetch_add(1, memory_order_relaxed);
+                reactor->queued_bytes.fetch_sub(terminal->out_bytes, memory_order_relaxed);
+                terminal->outq.clear();
+                terminal->out_offset = 0;
+                terminal->out_bytes = 0;
+                end_connection(reactor, terminal->id);
+            }
+        }
+    }
+    if (terminal->socket == -1) {
+        release_terminal(terminal);
     }
-    end_connection(id);
 }
@@ -9,60 +9,424 @@
 #include <string.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <sys/uio.h>
+#include <sys/resource.h>
 #include <thread>
 #include <mutex>
 
+#include "ClientRegistry.h"
+#include "EventLoop.h"
+#include "Handoff.h"
+#include "Histogram.h"
+#include "Logger.h"
+#include "Pool.h"
+#include "Protocol.h"
+#include "RingQueue.h"
+#include "Uring.h"
+
 
-#define MAX_LEN 200
 #define NUM_COLORS 6
+#define DEFAULT_ROOM "大厅"    // Room every client starts in
+#define HISTORY_KEEP_SECONDS 600 // Time an empty room keeps its history
 
 using namespace std;
 
 class ChatServer {
 public:
-    // Constructor to initialize the chat server with a given port
-    ChatServer(int port);
+    // Constructor to initialize the chat server with a given port and number
+    // of event loop threads (0 means one per CPU core)
+    ChatServer(int port, int num_loops = 0);
+
+    // Policy applied when a client's output queue passes its high-water mark
+    enum OverflowPolicy {
+        DROP_OLDEST,    // Discard the oldest queued frames
+        DROP_CHAT,      // Discard new chat frames, keep system notices
+        DISCONNECT      // Close the client after a grace period over the mark
+    };
+
+    // Struct to configure the per-client output limits
+    struct OutputLimits {
+        size_t max_bytes;       // High-water mark of queued bytes
+        size_t max_frames;      // High-water mark of queued frames
+        OverflowPolicy policy;  // What to do once either mark is passed
+        int grace_seconds;      // DISCONNECT: seconds allowed over the mark
+    };
+
+    // Struct to configure the liveness checks, in seconds (0 turns one off)
+    struct Timeouts {
+        int handshake;  // Time a new client has to send its hello
+        int heartbeat;  // Silence after which the client is pinged
+        int idle;       // Silence after which the client is dropped
+    };
+
+    // Struct to configure the per-room history replayed to joiners; the
+    // oldest messages go once either limit is passed
+    struct HistoryLimits {
+        size_t max_frames;  // Chat messages kept per room (0 turns it off)
+        size_t max_bytes;   // Encoded bytes kept per room
+    };
+
+    // I/O backend driving the client sockets
+    enum Backend {
+        BACKEND_EPOLL,      // Readiness: recv/sendmsg when epoll says so
+        BACKEND_IO_URING    // Completion: multishot accept/recv, batched sends
+    };
+
+    // Struct to report how often each overflow policy kicked in
+    struct OverflowStats {
+        uint64_t dropped_oldest;    // Frames discarded by DROP_OLDEST
+        uint64_t dropped_chat;      // Frames discarded by DROP_CHAT
+        uint64_t disconnected;      // Clients closed by DISCONNECT
+    };
+
+    // Struct to report heap allocations made by the reactor threads while
+    // they handle client input, broadcasts and output
+    struct AllocStats {
+        uint64_t messages;      // Chat messages broadcast so far
+        uint64_t allocations;   // operator new calls on that path so far
+    };
+
+    // Struct to hold the latency of each stage of the message path, in
+    // nanoseconds, merged from every reactor
+    struct LatencyStats {
+        Histogram parse;        // recv complete -> frame parsed
+        Histogram fanout;       // frame parsed -> queued for every recipient
+                                // on the sender's reactor, inboxes posted
+        Histogram queue_wait;   // queued -> last byte written, per recipient
+        Histogram recv_to_send; // recv complete -> last byte written, per
+                                // recipient of a chat message
+    };
+
+    // Method to set the output limits; call before start()
+    void set_output_limits(const OutputLimits& limits);
+
+    // Method to set the liveness timeouts; call before start()
+    void set_timeouts(const Timeouts& timeouts);
+
+    // Method to set the per-room history limits; call before start()
+    void set_history_limits(const HistoryLimits& limits);
+
+    // Method to choose the I/O backend; call before start(). io_uring falls
+    // back to epoll when the kernel lacks support
+    void set_backend(Backend backend);
+
+    // Method to set the largest accepted frame body; call before start().
+    // Returns false, keeping the old limit, for 0 or above FRAME_LIMIT_LEN
+    bool set_max_message_size(size_t bytes);
+
+    // Method to serve Prometheus metrics over HTTP on a port (0 turns it
+    // off, the default); call before start()
+    void set_metrics_port(int port);
+
+    // Method to enable hot restart through a Unix socket at path; call
+    // before start(). A server started with the path of a running one takes
+    // over its listeners and clients, and the old one exits
+    void set_handoff_path(const string& path);
+
+    // Method to render every counter in the Prometheus text format (safe
+    // from any thread)
+    string metrics_text() const;
+
+    // Method to read the overflow counters (safe from any thread)
+    OverflowStats overflow_stats() const;
+
+    // Method to read the allocation counters (safe from any thread); the
+    // counts come from Alloc.cpp, so they stay 0 unless it is linked in
+    AllocStats alloc_stats() const;
+
+    // Method to merge the latency histograms of every reactor into stats
+    // (safe from any thread; the reactors keep recording meanwhile)
+    void latency_stats(LatencyStats& stats) const;
+
+    // Method to access the logger, e.g. to set its level or a file sink
+    Logger& get_logger();
 
     // Method to start the chat server
     void start();
 
 private:
+    struct Reactor;
+
+    // Encoded frame shared read-only by every recipient's output queue
+    typedef SharedBuffer SharedFrame;
+
+    static const int MAX_IOV = 64;  // Frames gathered into one sendmsg
+    static const size_t FLUSH_BYTES = 64 * 1024; // Queued bytes that flush without waiting for the round
+    static const int URING_MAX_IOV = 1024; // Frames gathered into one io_uring send
+    static const unsigned URING_BATCH = 256; // Completions handled between submits
+
+    // Operation tags stored in the low bits of io_uring user_data
+    enum UringOp {
+        URING_ACCEPT = 1,
+        URING_RECV = 2,
+        URING_SEND = 3
+    };
+
+    // Struct to represent a frame in a client's output queue
+    struct OutFrame {
+        SharedFrame frame;
+        uint64_t received;          // When the chat message was read, 0 if none
+        uint64_t queued;            // When the frame joined the queue
+    };
+
     // Struct to represent a connected terminal (client)
     struct Terminal {
         int id;
         string name;
         int socket;
+        bool named;                 // Whether the hello frame has arrived
+        FrameDecoder decoder;       // Reassembles frames from received bytes
+        RingQueue<OutFrame> outq;   // Frames waiting for the socket to drain
+        size_t out_offset;          // Bytes of outq.front() already sent
+        size_t out_bytes;           // Bytes held by outq, including sent ones
+        bool over_limit;            // Whether outq is past the high-water mark
+        string room;                // Current room, empty before the hello
+        size_t room_pos;            // Index in the reactor's member list
+        EventLoop::Channel channel; // epoll registration of socket
+        EventLoop::Timer liveness;  // Handshake deadline, then heartbeat checks
+        EventLoop::Timer flusher;   // Flush deferred to the end of the round
+        EventLoop::Timer overflow;  // DISCONNECT: grace deadline over the mark
+        uint64_t last_recv;         // Loop time of the last bytes received
+        uint64_t history_seq;       // Newest history entry replayed on join;
+                                    // later ones arrive as live broadcasts
+        Reactor* reactor;           // Event loop owning this terminal
+        msghdr send_msg;            // io_uring: header of the send in flight
+        vector<iovec> send_iov;     // io_uring: its iovecs, sized to the backlog
+        int uring_ops;              // io_uring: operations still in flight
+        size_t inflight_frames;     // io_uring: outq frames the kernel is sending
+    };
+
+    // Struct to represent a broadcast waiting in another reactor's inbox
+    struct Delivery {
+        SharedFrame frame;
+        int sender_id;
+        uint64_t received;
+        uint64_t seq;               // History sequence number, 0 if none
+        string room;
+    };
+
+    // Struct to hold a room's recent chat frames, oldest first; they are
+    // the very buffers that were broadcast
+    struct RoomHistory {
+        RingQueue<SharedFrame> frames;
+        size_t bytes = 0;
+        uint64_t emptied_ns = 0;    // When the room lost its last member, 0 while in use
+    };
+
+    // Struct to represent one event loop thread with its own listener and
+    // the clients it accepted; only that thread touches clients
+    struct Reactor {
+        EventLoop loop;
+        int server_socket;
+        EventLoop::Channel accept_channel;
+        ObjectPool<Terminal> terminals; // Terminals of current and past clients
+        unordered_map<int, Terminal*> clients;
+        unordered_map<string, vector<Terminal*>> rooms; // Room -> local members
+        unique_ptr<Uring> uring;    // io_uring instance, null with epoll
+        EventLoop::Channel uring_channel; // epoll registration of the ring fd
+        bool frozen = false;        // Handing off: no accepts, reads or writes
+        bool accepting = true;      // io_uring: the multishot accept is armed
+        Frame frame;                // Scratch frame reused by process_input
+        uint64_t recv_time = 0;     // When the input being parsed was read
+        LatencyStats latency;       // Recorded by the loop thread only
+        string log_line;            // Scratch text reused for chat log lines
+        vector<SharedFrame> replay; // Scratch copy of a history being replayed
+        mutex inbox_mtx;            // Mutex guarding inbox and inbox_count
+        vector<Delivery> inbox;     // Broadcasts posted by other reactors
+        size_t inbox_count = 0;     // Entries of inbox in use; the rest are spare
+        vector<Delivery> inbox_work; // Loop thread: batch being delivered
+        atomic<uint64_t> messages{0};    // Chat messages received here
+        atomic<uint64_t> allocations{0}; // Heap allocations while handling I/O
+        atomic<uint64_t> accepted{0};    // Connections accepted
+        atomic<uint64_t> closed{0};      // Connections ended
+        atomic<uint64_t> bytes_in{0};    // Bytes read from clients
+        atomic<uint64_t> bytes_out{0};   // Bytes written to clients
+        atomic<uint64_t> errors{0};      // Malformed input and failed sends
+        atomic<uint64_t> timed_out{0};   // Clients dropped by a liveness check
+        atomic<int64_t> queued_bytes{0}; // Bytes held by output queues
         thread th;
     };
 
-    vector<Terminal> clients;   // List of connected clients
+    // Struct to represent a client in the server-wide directory
+    struct ClientInfo {
+        string name;
+        Reactor* reactor;
+    };
+
+    vector<unique_ptr<Reactor>> reactors; // One per event loop thread
+    ClientRegistry<ClientInfo> registry;  // Named clients across all reactors
     string def_col;             // Default color code
     string colors[NUM_COLORS];  // Color codes for different clients
-    int seed;                   // Seed for generating client IDs
-    mutex cout_mtx, clients_mtx;// Mutex for thread safety
-    int server_socket;          // Server socket descriptor
+    atomic<int> seed;           // Seed for generating client IDs
+    Logger logger;              // Asynchronous console and file logger
     int port;                   // Port on which the server listens
+    int num_loops;              // Number of event loop threads
+    OutputLimits limits;        // Per-client output queue limits
+    Timeouts timeouts;          // Liveness checks
+    SharedFrame ping;           // Encoded once, queued to every silent client
+    size_t max_message_size;    // Largest frame body a client may send
+    Backend backend;            // I/O backend in use
+    atomic<uint64_t> dropped_oldest, dropped_chat, disconnected; // Overflow counters
+    int metrics_port;           // HTTP port of /metrics, 0 if off
+    int metrics_socket;         // Listener of /metrics, -1 if off
+    string handoff_path;        // Unix socket for hot restart, empty if off
+    int handoff_socket;         // Listener waiting for a successor
+    bool handed_off;            // Whether a successor took over
+    atomic<bool> stopping;      // Tells the admin thread to return
+    thread admin_th;            // Thread answering scrapes and handoffs
+    map<string, int> room_sizes;// Members per room across all reactors
+    mutex rooms_mtx;            // Mutex guarding room_sizes
+    HistoryLimits history_limits; // Per-room history size
+    unordered_map<string, RoomHistory> histories; // Room -> recent chat frames
+    uint64_t history_seq;       // Chat frames recorded so far, all rooms
+    mutex history_mtx;          // Mutex guarding histories and history_seq
 
     // Method to get color code based on client ID
     string color(int code);
 
     // Method to set the name of a client
-    void set_name(int id, const char* name);
+    void set_name(Terminal* terminal, const char* name);
+
+    // Thread-safe method to print shared messages without waiting on I/O
+    void shared_print(const string& str, LogLevel level = LOG_INFO);
+
+    // Method to broadcast a frame to a room, except to the sender; received
+    // is when a relayed chat message was read, for the latency stats
+    void broadcast_message(const string& room, uint8_t type, int sender_id,
+                           const string& name, const string& payload, uint64_t received = 0);
+
+    // Method to hand an encoded frame to every reactor for delivery; seq is
+    // its history sequence number, 0 if it is not kept
+    void broadcast_bytes(const string& room, const SharedFrame& frame, int sender_id, uint64_t received,
+                         uint64_t seq);
+
+    // Method to queue a broadcast in another reactor's inbox
+    void post(Reactor* reactor, const string& room, const SharedFrame& frame, int sender_id, uint64_t received,
+              uint64_t seq);
+
+    // Method to deliver every broadcast waiting in a reactor's inbox
+    void drain_inbox(Reactor* reactor);
+
+    // Method to deliver an encoded frame to a room's members on one reactor,
+    // except to those who already got it from the history replay
+    void deliver(Reactor* reactor, const string& room, const SharedFrame& frame, int sender_id, uint64_t received,
+                 uint64_t seq);
+
+    // Method to add a chat frame to a room's history; returns its sequence
+    // number, 0 if history is off
+    uint64_t remember(const string& room, const SharedFrame& frame);
+
+    // Method to queue a room's history to a client that just joined it
+    void replay_history(Terminal* terminal);
 
-    // Thread-safe method to print shared messages
-    void shared_print(const string& str, bool endLine = true);
+    // Method to move a client into a room, leaving its current one
+    void join_room(Terminal* terminal, const string& room);
 
-    // Method to broadcast message to all clients except the sender
-    void broadcast_message(const string& message, int sender_id);
+    // Method to take a client out of its current room
+    void leave_room(Terminal* terminal);
 
-    // Method to broadcast a number to all clients except the sender
-    void broadcast_message(int num, int sender_id);
+    // Method to handle a "#..." command; false if the text is a chat message
+    bool handle_command(Terminal* terminal, const string& text);
+
+    // Method to run a client's liveness timer: close it if it never said
+    // hello or went silent for too long, ping it after a shorter silence
+    void check_liveness(Terminal* terminal);
+
+    // Method to schedule a client's next liveness check after the handshake
+    void arm_heartbeat(Terminal* terminal);
+
+    // Method to send one frame to a single client
+    void send_to(Terminal* terminal, uint8_t type, const string& payload);
 
     // Method to end the connection with a client
-    void end_connection(int id);
+    void end_connection(Reactor* reactor, int id);
+
+    // Method to open a SO_REUSEPORT listening socket for one reactor
+    int open_listener();
+
+    // Method to answer scrapes and handoff requests until stopping is set
+    void serve_admin();
+
+    // Method to answer one HTTP request on the metrics listener
+    void answer_scrape(int client);
+
+    // Method to run a functor on a reactor's loop thread and wait for it
+    void run_and_wait(Reactor* reactor, const function<void()>& functor);
+
+    // Method to pass listeners and clients to a successor on link; true once
+    // it took them over, false (and the reactors run on) otherwise
+    bool hand_off(int link);
+
+    // Method to stop a reactor accepting, reading and writing for a handoff
+    void freeze(Reactor* reactor);
+
+    // Method to check whether a frozen reactor has no I/O in flight
+    bool quiet(Reactor* reactor);
+
+    // Method to write the state of a frozen reactor's clients as records
+    void save_clients(Reactor* reactor, vector<pair<string, int>>& records);
+
+    // Method to let a reactor serve its clients again after a failed handoff
+    void thaw(Reactor* reactor);
+
+    // Method to read a predecessor's state from link; exits on a broken link
+    void receive_handoff(int link, vector<int>& listeners, vector<pair<string, int>>& clients);
+
+    // Method to rebuild a client passed on by the predecessor
+    void adopt_client(Reactor* reactor, const string& record, int client_socket);
+
+    // Method to accept every pending connection on a reactor's listener
+    void handle_accept(Reactor* reactor);
+
+    // Method to set up state for a freshly accepted client socket; id 0
+    // draws a new one
+    Terminal* add_client(Reactor* reactor, int client_socket, int id = 0);
+
+    // Method to close a client's socket and free it once no I/O refers to it
+    void release_terminal(Terminal* terminal);
+
+    // Method to dispatch readiness events of a client socket
+    void handle_event(Terminal* terminal, uint32_t events);
+
+    // Method to drain a client socket and process complete frames
+    void handle_read(Terminal* terminal);
+
+    // Method to handle every complete frame buffered for a client
+    void process_input(Terminal* terminal, bool peer_closed);
+
+    // Method to handle the complete frames buffered for a client until it closes
+    void process_frames(Terminal* terminal);
+
+    // Method to handle one frame received from a client
+    void handle_frame(Terminal* terminal, const Frame& frame);
+
+    // Method to queue a frame for a client without copying it
+    void queue_send(Terminal* terminal, const SharedFrame& frame, uint64_t received = 0);
+
+    // Method to apply the overflow policy to a client past its mark
+    void handle_overflow(Terminal* terminal);
+
+    // Method to run a client's overflow deadline: close it if its queue is
+    // still past the mark once the grace period is over
+    void check_overflow(Terminal* terminal);
+
+    // Method to write as much of a client's pending output as possible
+    void flush(Terminal* terminal);
+
+    // Method to fill up to max entries of iov from a client's output queue
+    int gather_output(Terminal* terminal, iovec* iov, int max);
+
+    // Method to release output the socket has accepted
+    void consume_output(Terminal* terminal, size_t sent);
+
+    // Method to submit a client's queued output as one io_uring send
+    void uring_flush(Terminal* terminal);
+
+    // Method to handle every completion posted to a reactor's ring
+    void handle_uring(Reactor* reactor);
 
-    // Method to handle client communication
-    void handle_client(int client_socket, int id);
+    // Method to handle one io_uring completion
+    void handle_completion(Reactor* reactor, const io_uring_cqe& cqe);
 };
 
 #endif // CHATSERVER_H
@@ -0,0 +1,206 @@
+#ifndef CLIENTREGISTRY_H
+#define CLIENTREGISTRY_H
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Read-mostly directory of connected clients keyed by id.
+//
+// Entries live in a chunked slot table. Readers walk it without taking any
+// lock: they only announce the epoch they started in. Writers serialize on a
+// mutex, publish or clear one slot (O(1) by id), and retire removed entries.
+// A retired entry is freed once every reader that could still see it has
+// left, which is classic epoch-based reclamation.
+template <typename V>
+class ClientRegistry {
+public:
+    ClientRegistry() : high_water(0), global_epoch(1) {
+        for (int i = 0; i < MAX_CHUNKS; i++) {
+            chunks[i].store(nullptr, memory_order_relaxed);
+        }
+        for (int i = 0; i < MAX_READERS; i++) {
+            readers[i].epoch.store(0, memory_order_relaxed);
+        }
+    }
+
+    ~ClientRegistry() {
+        for (int i = 0; i < MAX_CHUNKS; i++) {
+            atomic<Entry*>* chunk = chunks[i].load(memory_order_relaxed);
+            if (!chunk) {
+                continue;
+            }
+            for (size_t j = 0; j < CHUNK_SIZE; j++) {
+                delete chunk[j].load(memory_order_relaxed);
+            }
+            delete[] chunk;
+        }
+        for (auto& retired_entry : retired) {
+            delete retired_entry.second;
+        }
+    }
+
+    // Method to add a client, replacing any entry with the same id
+    void insert(int id, const V& value) {
+        lock_guard<mutex> guard(writer_mtx);
+        auto it = index.find(id);
+        if (it != index.end()) {
+            replace(it->second, new Entry{id, value});
+            return;
+        }
+        size_t slot = allocate_slot();
+        index[id] = slot;
+        slot_ref(slot).store(new Entry{id, value}, memory_order_seq_cst);
+    }
+
+    // Method to remove a client; returns false if the id is unknown
+    bool remove(int id) {
+        lock_guard<mutex> guard(writer_mtx);
+        auto it = index.find(id);
+        if (it == index.end()) {
+            return false;
+        }
+        size_t slot = it->second;
+        index.erase(it);
+        replace(slot, nullptr);
+        free_slots.push_back(slot);
+        return true;
+    }
+
+    // Method to call fn(id, value) for every client in a consistent-enough
+    // snapshot; entries seen here stay valid until fn returns
+    template <typename F>
+    void for_each(F fn) const {
+        ReadGuard guard(*this);
+        size_t limit = high_water.load(memory_order_acquire);
+        for (size_t slot = 0; slot < limit; slot++) {
+            const Entry* entry = slot_ref(slot).load(memory_order_seq_cst);
+            if (entry) {
+                fn(entry->id, entry->value);
+            }
+        }
+    }
+
+    // Method to get the number of registered clients
+    size_t size() const {
+        lock_guard<mutex> guard(writer_mtx);
+        return index.size();
+    }
+
+private:
+    static const int CHUNK_BITS = 12;
+    static const size_t CHUNK_SIZE = size_t(1) << CHUNK_BITS; // Slots per chunk
+    static const int MAX_CHUNKS = 1024;                       // Up to 4M clients
+    static const int MAX_READERS = 256;                       // Concurrent readers
+
+    struct Entry {
+        int id;
+        V value;
+    };
+
+    // One cache line per reader so announcing an epoch does not false-share
+    struct alignas(64) ReaderSlot {
+        atomic<uint64_t> epoch;  // 0 when the slot is free
+    };
+
+    // RAII registration of a reader in the current epoch
+    class ReadGuard {
+    public:
+        explicit ReadGuard(const ClientRegistry& registry) : registry(registry) {
+            thread_local int hint = 0;
+            uint64_t epoch = registry.global_epoch.load(memory_order_seq_cst);
+            for (int i = hint;; i = (i + 1) % MAX_READERS) {
+                uint64_t expected = 0;
+                if (registry.readers[i].epoch.compare_exchange_strong(expected, epoch,
+                                                                       memory_order_seq_cst)) {
+                    slot = i;
+                    hint = i;
+                    return;
+                }
+            }
+        }
+
+        ~ReadGuard() {
+            registry.readers[slot].epoch.store(0, memory_order_release);
+        }
+
+    private:
+        const ClientRegistry& registry;
+        int slot;
+    };
+
+    mutable atomic<atomic<Entry*>*> chunks[MAX_CHUNKS]; // Slot table
+    atomic<size_t> high_water;                  // Slots ever handed out
+    atomic<uint64_t> global_epoch;              // Bumped on every retire
+    mutable ReaderSlot readers[MAX_READERS];    // Epochs of active readers
+    mutable mutex writer_mtx;                   // Serializes writers
+    unordered_map<int, size_t> index;           // id -> slot, writers only
+    vector<size_t> free_slots;                  // Reusable slots
+    vector<pair<uint64_t, Entry*>> retired;     // Unlinked, not yet freed
+
+    // Method to get a slot by index; its chunk must already exist
+    atomic<Entry*>& slot_ref(size_t slot) const {
+        return chunks[slot >> CHUNK_BITS].load(memory_order_acquire)[slot & (CHUNK_SIZE - 1)];
+    }
+
+    // Method to take a free slot or extend the table (writer lock held)
+    size_t allocate_slot() {
+        if (!free_slots.empty()) {
+            size_t slot = free_slots.back();
+            free_slots.pop_back();
+            return slot;
+        }
+        size_t slot = high_water.load(memory_order_relaxed);
+        size_t chunk = slot >> CHUNK_BITS;
+        if (chunk >= static_cast<size_t>(MAX_CHUNKS)) {
+            throw length_error("ClientRegistry full");
+        }
+        if (!chunks[chunk].load(memory_order_relaxed)) {
+            atomic<Entry*>* fresh = new atomic<Entry*>[CHUNK_SIZE];
+            for (size_t j = 0; j < CHUNK_SIZE; j++) {
+                fresh[j].store(nullptr, memory_order_relaxed);
+            }
+            chunks[chunk].store(fresh, memory_order_release);
+        }
+        high_water.store(slot + 1, memory_order_release);
+        return slot;
+    }
+
+    // Method to swap a slot's entry and retire the old one (writer lock held)
+    void replace(size_t slot, Entry* entry) {
+        Entry* old = slot_ref(slot).exchange(entry, memory_order_seq_cst);
+        if (old) {
+            retired.emplace_back(global_epoch.fetch_add(1, memory_order_seq_cst), old);
+        }
+        reclaim();
+    }
+
+    // Method to free retired entries no active reader can still see
+    void reclaim() {
+        uint64_t oldest = UINT64_MAX;
+        for (int i = 0; i < MAX_READERS; i++) {
+            uint64_t epoch = readers[i].epoch.load(memory_order_seq_cst);
+            if (epoch != 0 && epoch < oldest) {
+                oldest = epoch;
+            }
+        }
+        size_t kept = 0;
+        for (auto& retired_entry : retired) {
+            // A reader that started in a later epoch found the slot cleared
+            if (retired_entry.first < oldest) {
+                delete retired_entry.second;
+            } else {
+                retired[kept++] = retired_entry;
+            }
+        }
+        retired.resize(kept);
+    }
+};
+
+#endif // CLIENTREGISTRY_H
@@ -0,0 +1,188 @@
+#include "EventLoop.h"
+
+#include <sys/eventfd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+#include <climits>
+
+// Constructor to create the epoll instance and its wakeup eventfd
+EventLoop::EventLoop()
+    : epoll_fd(-1), wakeup_fd(-1), quit_flag(false), calling_pending(false),
+      calling_timers(false), owner(this_thread::get_id()), events(1024), now_ms(clock_ms()), timers(now_ms) {
+    if ((epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+        perror("epoll_create1: ");
+        exit(EXIT_FAILURE);
+    }
+    if ((wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) {
+        perror("eventfd: ");
+        exit(EXIT_FAILURE);
+    }
+    wakeup_channel.fd = wakeup_fd;
+    wakeup_channel.callback = [this](uint32_t) { handle_wakeup(); };
+    add(&wakeup_channel, EPOLLIN | EPOLLET);
+}
+
+EventLoop::~EventLoop() {
+    close(wakeup_fd);
+    close(epoll_fd);
+}
+
+// Method to run the event loop until quit() is called
+void EventLoop::loop() {
+    owner = this_thread::get_id();
+    while (!quit_flag) {
+        if (before_wait) {
+            before_wait();
+        }
+        int64_t timeout = timers.next_timeout();
+        int n = epoll_wait(epoll_fd, events.data(), static_cast<int>(events.size()),
+                           timeout < 0 ? -1 : static_cast<int>(min<int64_t>(timeout, INT_MAX)));
+        now_ms = clock_ms();
+        if (n == -1) {
+            if (errno != EINTR) {
+                perror("epoll_wait: ");
+            }
+            continue;
+        }
+        for (int i = 0; i < n; i++) {
+            Channel* channel = static_cast<Channel*>(events[i].data.ptr);
+            channel->callback(events[i].events);
+        }
+        // Grow the event buffer when it was filled, so a busy loop drains faster
+        if (n == static_cast<int>(events.size())) {
+            events.resize(events.size() * 2);
+        }
+        run_pending();
+        // Deferred work and due timers run last, so what they queue goes out
+        // with before_wait
+        calling_timers = true;
+        timers.advance(now_ms);
+        calling_timers = false;
+    }
+}
+
+// Method to stop the event loop (safe from any thread)
+void EventLoop::quit() {
+    quit_flag = true;
+    if (!in_loop_thread()) {
+        wakeup();
+    }
+}
+
+// Methods to register, update and unregister a channel with epoll
+void EventLoop::add(Channel* channel, uint32_t events) {
+    epoll_event ev;
+    ev.events = events;
+    ev.data.ptr = channel;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, channel->fd, &ev) == -1) {
+        perror("epoll_ctl add: ");
+    }
+}
+
+void EventLoop::modify(Channel* channel, uint32_t events) {
+    epoll_event ev;
+    ev.events = events;
+    ev.data.ptr = channel;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, channel->fd, &ev) == -1) {
+        perror("epoll_ctl mod: ");
+    }
+}
+
+void EventLoop::remove(Channel* channel) {
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_DEL, channel->fd, nullptr) == -1) {
+        perror("epoll_ctl del: ");
+    }
+}
+
+// Method to run a functor on the loop thread, immediately if already there
+void EventLoop::run_in_loop(Functor functor) {
+    if (in_loop_thread()) {
+        functor();
+    } else {
+        queue_in_loop(move(functor));
+    }
+}
+
+// Method to queue a functor to run after the current batch of events
+void EventLoop::queue_in_loop(Functor functor) {
+    bool was_empty;
+    {
+        lock_guard<mutex> guard(pending_mtx);
+        was_empty = pending.empty();
+        pending.push_back(move(functor));
+    }
+    // Only the first functor of a batch pays for the eventfd write; a functor
+    // queued while pending ones or timers run needs another pass of the loop
+    if ((was_empty && !in_loop_thread()) || calling_pending || calling_timers) {
+        wakeup();
+    }
+}
+
+// Method to check whether the caller is running on the loop thread
+bool EventLoop::in_loop_thread() const {
+    return owner == this_thread::get_id();
+}
+
+// Method to set a functor run on the loop thread before every wait,
+// after the events and queued functors of the previous round
+void EventLoop::set_before_wait(Functor functor) {
+    before_wait = move(functor);
+}
+
+// Method to run a timer's callback delay_ms from now
+void EventLoop::add_timer(Timer* timer, uint64_t delay_ms) {
+    if (delay_ms == 0) {
+        timers.defer(timer);
+    } else {
+        timers.schedule(timer, now_ms + delay_ms);
+    }
+}
+
+// Method to unschedule a timer (loop thread only)
+void EventLoop::cancel_timer(Timer* timer) {
+    timers.cancel(timer);
+}
+
+// Method to get the loop's clock in milliseconds, read once per round
+uint64_t EventLoop::now() const {
+    return now_ms;
+}
+
+// Method to read the monotonic clock in milliseconds (vDSO, no syscall)
+uint64_t EventLoop::clock_ms() {
+    return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Method to interrupt a blocking epoll_wait
+void EventLoop::wakeup() {
+    uint64_t one = 1;
+    if (write(wakeup_fd, &one, sizeof(one)) != sizeof(one) && errno != EAGAIN) {
+        perror("eventfd write: ");
+    }
+}
+
+// Method to drain the eventfd after a wakeup
+void EventLoop::handle_wakeup() {
+    uint64_t count;
+    while (read(wakeup_fd, &count, sizeof(count)) > 0) {
+    }
+}
+
+// Method to run every queued functor
+void EventLoop::run_pending() {
+    // Both vectors keep their capacity, so queueing a functor stops
+    // allocating once the loop has seen its busiest round
+    calling_pending = true;
+    {
+        lock_guard<mutex> guard(pending_mtx);
+        running.swap(pending);
+    }
+    for (auto& functor : running) {
+        functor();
+    }
+    running.clear();
+    calling_pending = false;
+}
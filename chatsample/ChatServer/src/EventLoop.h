@@ -0,0 +1,98 @@
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#include <sys/epoll.h>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "TimerWheel.h"
+
+using namespace std;
+
+// Edge-triggered epoll reactor. All registered callbacks run on the thread
+// that calls loop(); other threads talk to the loop through run_in_loop().
+// Timers live in a millisecond timing wheel that sets the epoll_wait
+// timeout, so they cost no file descriptor or system call of their own.
+class EventLoop {
+public:
+    typedef function<void(uint32_t)> EventCallback;
+    typedef function<void()> Functor;
+    typedef TimerWheel::Timer Timer;
+
+    // Registration record for one descriptor. The owner keeps it alive until
+    // remove() has been called and the current batch of events is finished.
+    struct Channel {
+        int fd;
+        EventCallback callback;
+    };
+
+    EventLoop();
+    ~EventLoop();
+
+    // Method to run the event loop until quit() is called
+    void loop();
+
+    // Method to stop the event loop (safe from any thread)
+    void quit();
+
+    // Methods to register, update and unregister a channel with epoll
+    void add(Channel* channel, uint32_t events);
+    void modify(Channel* channel, uint32_t events);
+    void remove(Channel* channel);
+
+    // Method to run a functor on the loop thread, immediately if already there
+    void run_in_loop(Functor functor);
+
+    // Method to queue a functor to run after the current batch of events
+    void queue_in_loop(Functor functor);
+
+    // Method to check whether the caller is running on the loop thread
+    bool in_loop_thread() const;
+
+    // Method to set a functor run on the loop thread before every wait,
+    // after the events, queued functors and timers of the previous round
+    void set_before_wait(Functor functor);
+
+    // Method to run a timer's callback delay_ms from now; 0 defers it to the
+    // end of the current round (loop thread only, or before loop() starts)
+    void add_timer(Timer* timer, uint64_t delay_ms);
+
+    // Method to unschedule a timer (loop thread only)
+    void cancel_timer(Timer* timer);
+
+    // Method to get the loop's clock in milliseconds, read once per round
+    uint64_t now() const;
+
+private:
+    int epoll_fd;               // epoll instance descriptor
+    int wakeup_fd;              // eventfd used to interrupt epoll_wait
+    Channel wakeup_channel;     // Channel for wakeup_fd
+    atomic<bool> quit_flag;     // Set to leave loop()
+    atomic<bool> calling_pending; // Whether pending functors are being run
+    atomic<bool> calling_timers; // Whether timer callbacks are being run
+    atomic<thread::id> owner;   // Thread running loop()
+    mutex pending_mtx;          // Mutex guarding pending
+    vector<Functor> pending;    // Functors queued from other threads
+    vector<Functor> running;    // Functors being run, swapped with pending
+    vector<epoll_event> events; // Buffer filled by epoll_wait
+    Functor before_wait;        // Hook run before each epoll_wait
+    uint64_t now_ms;            // Monotonic time when the last wait returned
+    TimerWheel timers;          // Timers of this loop, ticking in milliseconds
+
+    // Method to read the monotonic clock in milliseconds (vDSO, no syscall)
+    static uint64_t clock_ms();
+
+    // Method to interrupt a blocking epoll_wait
+    void wakeup();
+
+    // Method to drain the eventfd after a wakeup
+    void handle_wakeup();
+
+    // Method to run every queued functor
+    void run_pending();
+};
+
+#endif // EVENTLOOP_H
@@ -0,0 +1,160 @@
+#include "Handoff.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static const uint32_t MAX_RECORD = 64 << 20; // Bigger lengths mean a broken link
+
+// Method to fill a Unix socket address; false if the path does not fit
+static bool unix_address(const string& path, sockaddr_un& addr) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        return false;
+    }
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+// Method to write all of len bytes
+static bool send_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::send(fd, data, len, MSG_NOSIGNAL);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Method to read exactly len bytes
+static bool recv_all(int fd, char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::recv(fd, data, len, 0);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Method to listen for a successor at path, replacing a stale socket file
+int Handoff::listen(const string& path) {
+    sockaddr_un addr;
+    if (!unix_address(path, addr)) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    // A previous server that handed off (or crashed) leaves its file behind
+    unlink(path.c_str());
+    if (bind(fd, (sockaddr*)&addr, sizeof(addr)) == -1 || ::listen(fd, 1) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Method to connect to a running server at path; -1 if none listens
+int Handoff::connect(const string& path) {
+    sockaddr_un addr;
+    if (!unix_address(path, addr)) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    if (::connect(fd, (sockaddr*)&addr, sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Method to send one record with an optional descriptor
+bool Handoff::send(int link, const string& record, int fd) {
+    // The descriptor rides on the length prefix, so the receiver picks it
+    // up with the first read of the record
+    uint32_t len = static_cast<uint32_t>(record.size());
+    iovec iov;
+    iov.iov_base = &len;
+    iov.iov_len = sizeof(len);
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    char control[CMSG_SPACE(sizeof(int))];
+    if (fd != -1) {
+        memset(control, 0, sizeof(control));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+
+    ssize_t n;
+    do {
+        n = sendmsg(link, &msg, MSG_NOSIGNAL);
+    } while (n == -1 && errno == EINTR);
+    if (n <= 0) {
+        return false;
+    }
+    // A short write of the prefix carries the descriptor all the same
+    return send_all(link, reinterpret_cast<const char*>(&len) + n, sizeof(len) - n) &&
+           send_all(link, record.data(), record.size());
+}
+
+// Method to receive one record
+bool Handoff::recv(int link, string& record, int& fd) {
+    fd = -1;
+    uint32_t len;
+    iovec iov;
+    iov.iov_base = &len;
+    iov.iov_len = sizeof(len);
+    char control[CMSG_SPACE(sizeof(int))];
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n;
+    do {
+        n = recvmsg(link, &msg, MSG_CMSG_CLOEXEC);
+    } while (n == -1 && errno == EINTR);
+    if (n <= 0) {
+        return false;
+    }
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+    if (!recv_all(link, reinterpret_cast<char*>(&len) + n, sizeof(len) - n) || len > MAX_RECORD) {
+        return false;
+    }
+    record.resize(len);
+    return recv_all(link, &record[0], len);
+}
@@ -0,0 +1,90 @@
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <stdint.h>
+#include <string>
+
+using namespace std;
+
+// Link between a running server and the binary replacing it. The old
+// process listens on a Unix socket; the new one connects and reads a
+// sequence of records, each a length-prefixed byte string that may carry
+// one descriptor through SCM_RIGHTS. Sockets passed this way stay open
+// and keep their queued bytes, so clients never see the restart.
+class Handoff {
+public:
+    // Kinds of record, stored in the first byte
+    enum RecordType {
+        LISTENER = 1,   // fd: a client listener (one per reactor)
+        METRICS = 2,    // fd: the /metrics listener
+        CLIENT = 3,     // fd: a connected client, followed by its state
+        DONE = 4,       // End of the state; the new process acknowledges it
+        HISTORY = 5     // A room's recent chat frames, oldest first
+    };
+
+    // Method to listen for a successor at path, replacing a stale socket
+    // file; -1 on failure
+    static int listen(const string& path);
+
+    // Method to connect to a running server at path; -1 if none listens
+    static int connect(const string& path);
+
+    // Method to send one record with an optional descriptor (-1 for none)
+    static bool send(int link, const string& record, int fd = -1);
+
+    // Method to receive one record; fd is -1 if none came with it
+    static bool recv(int link, string& record, int& fd);
+};
+
+// Struct to build a record field by field
+struct RecordWriter {
+    string data;
+
+    explicit RecordWriter(uint8_t type) : data(1, static_cast<char>(type)) {}
+
+    void put_u32(uint32_t value) {
+        data.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void put_string(const string& value) {
+        put_u32(static_cast<uint32_t>(value.size()));
+        data += value;
+    }
+};
+
+// Struct to read a record back in the order it was written; ok turns false
+// once a field runs past the end
+struct RecordReader {
+    const string& data;
+    size_t pos;
+    bool ok;
+
+    explicit RecordReader(const string& data) : data(data), pos(1), ok(!data.empty()) {}
+
+    uint8_t type() const {
+        return data.empty() ? 0 : static_cast<uint8_t>(data[0]);
+    }
+
+    uint32_t get_u32() {
+        uint32_t value = 0;
+        if (!ok || data.size() - pos < sizeof(value)) {
+            ok = false;
+            return 0;
+        }
+        data.copy(reinterpret_cast<char*>(&value), sizeof(value), pos);
+        pos += sizeof(value);
+        return value;
+    }
+
+    string get_string() {
+        uint32_t len = get_u32();
+        if (!ok || data.size() - pos < len) {
+            ok = false;
+            return string();
+        }
+        pos += len;
+        return data.substr(pos - len, len);
+    }
+};
+
+#endif // HANDOFF_H
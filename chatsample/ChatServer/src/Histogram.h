@@ -0,0 +1,122 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+
+using namespace std;
+
+// HDR-style histogram of non-negative integers (e.g. nanoseconds). Values
+// below 128 get a bucket each; above that every power of two is split into
+// 64 buckets, so a reported value is within 1/64 (about 1.6%) of the real
+// one over the whole 64-bit range. Recording is a few instructions and
+// never allocates.
+//
+// One thread records into a histogram; any thread may merge it into
+// another one at the same time. The counters are relaxed atomics that only
+// their writer updates, so recording costs plain loads and stores and a
+// reader never makes the writer wait.
+class Histogram {
+public:
+    Histogram() : counts(new atomic<uint64_t>[BUCKETS]()), total(0), largest(0) {}
+
+    // Method to record one value (owning thread only)
+    void record(uint64_t value) {
+        add(counts[index(value)], 1);
+        add(total, 1);
+        if (value > largest.load(memory_order_relaxed)) {
+            largest.store(value, memory_order_relaxed);
+        }
+    }
+
+    // Method to add every value recorded so far by another histogram
+    // (owning thread of this one; other may be recording meanwhile)
+    void merge(const Histogram& other) {
+        uint64_t merged = 0;
+        for (size_t i = 0; i < BUCKETS; i++) {
+            uint64_t count = other.counts[i].load(memory_order_relaxed);
+            add(counts[i], count);
+            merged += count;
+        }
+        // Counted from the buckets so percentiles see a consistent total
+        add(total, merged);
+        uint64_t other_largest = other.largest.load(memory_order_relaxed);
+        if (other_largest > largest.load(memory_order_relaxed)) {
+            largest.store(other_largest, memory_order_relaxed);
+        }
+    }
+
+    // Method to forget every recorded value (owning thread only)
+    void clear() {
+        for (size_t i = 0; i < BUCKETS; i++) {
+            counts[i].store(0, memory_order_relaxed);
+        }
+        total.store(0, memory_order_relaxed);
+        largest.store(0, memory_order_relaxed);
+    }
+
+    // Method to get the value below which the given percentage of the
+    // recorded values fall (upper edge of its bucket, capped at max())
+    uint64_t percentile(double percent) const {
+        uint64_t values = count();
+        uint64_t top = max();
+        if (values == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(percent / 100.0 * values + 0.5);
+        rank = rank == 0 ? 1 : (rank > values ? values : rank);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; i++) {
+            seen += counts[i].load(memory_order_relaxed);
+            if (seen >= rank) {
+                uint64_t upper = highest(i);
+                return upper < top ? upper : top;
+            }
+        }
+        return top;
+    }
+
+    uint64_t count() const {
+        return total.load(memory_order_relaxed);
+    }
+
+    uint64_t max() const {
+        return largest.load(memory_order_relaxed);
+    }
+
+private:
+    static const int SUB_BITS = 7;                   // 128 linear buckets
+    static const uint64_t HALF = 1 << (SUB_BITS - 1); // Buckets per power of two
+    static const size_t BUCKETS = (2 * HALF) + (64 - SUB_BITS) * HALF;
+
+    unique_ptr<atomic<uint64_t>[]> counts; // Values recorded per bucket
+    atomic<uint64_t> total;     // Values recorded
+    atomic<uint64_t> largest;   // Largest value recorded
+
+    // Method to bump a counter only this thread writes
+    static void add(atomic<uint64_t>& counter, uint64_t by) {
+        counter.store(counter.load(memory_order_relaxed) + by, memory_order_relaxed);
+    }
+
+    // Method to map a value to its bucket
+    static size_t index(uint64_t value) {
+        if (value < 2 * HALF) {
+            return static_cast<size_t>(value);
+        }
+        int shift = 63 - __builtin_clzll(value) - (SUB_BITS - 1);
+        return 2 * HALF + (shift - 1) * HALF + ((value >> shift) - HALF);
+    }
+
+    // Method to get the largest value that maps to a bucket
+    static uint64_t highest(size_t i) {
+        if (i < 2 * HALF) {
+            return i;
+        }
+        int shift = static_cast<int>((i - 2 * HALF) / HALF) + 1;
+        uint64_t mantissa = (i - 2 * HALF) % HALF + HALF;
+        return ((mantissa + 1) << shift) - 1;
+    }
+};
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,235 @@
+#include "Logger.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char* level_names[] = {"DEBUG", "INFO ", "WARN ", "ERROR"};
+static const char* level_colors[] = {"\033[90m", "", "\033[33m", "\033[31m"};
+static const size_t MAX_BATCH = 4096;  // Records formatted per write()
+static const size_t SLOT_CAPACITY = 1024; // Text kept in a slot between uses
+
+// Method to copy text without ANSI color sequences
+static void append_plain(string& out, const string& text) {
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] == '\033' && i + 1 < text.size() && text[i + 1] == '[') {
+            size_t end = text.find('m', i);
+            if (end != string::npos) {
+                i = end;
+                continue;
+            }
+        }
+        out += text[i];
+    }
+}
+
+// Method to write a whole buffer, retrying short writes
+static void write_all(int fd, const string& data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = write(fd, data.data() + done, data.size() - done);
+        if (n <= 0) {
+            return;
+        }
+        done += n;
+    }
+}
+
+// Constructor to create a logger whose ring holds capacity records
+Logger::Logger(size_t capacity)
+    : head(0), tail(0), level(LOG_INFO), color(true), console(true), file_fd(-1),
+      running(false), sleeping(false), dropped_count(0) {
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    slots = vector<Slot>(size);
+    mask = size - 1;
+    for (size_t i = 0; i < size; i++) {
+        slots[i].seq.store(i, memory_order_relaxed);
+    }
+}
+
+// Destructor to flush every queued record and stop the writer thread
+Logger::~Logger() {
+    stop();
+    if (file_fd != -1) {
+        close(file_fd);
+    }
+}
+
+// Methods to configure the logger; call before start()
+void Logger::set_level(LogLevel level) {
+    this->level = level;
+}
+
+void Logger::set_color(bool enabled) {
+    color = enabled;
+}
+
+void Logger::set_console(bool enabled) {
+    console = enabled;
+}
+
+bool Logger::open_file(const string& path) {
+    int fd = open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        perror("open log file: ");
+        return false;
+    }
+    if (file_fd != -1) {
+        close(file_fd);
+    }
+    file_fd = fd;
+    return true;
+}
+
+// Method to start the background writer thread
+void Logger::start() {
+    if (running.exchange(true)) {
+        return;
+    }
+    writer = thread(&Logger::run, this);
+}
+
+// Method to drain the ring and stop the writer thread
+void Logger::stop() {
+    if (!running.exchange(false)) {
+        return;
+    }
+    {
+        lock_guard<mutex> guard(wake_mtx);
+        wake_cv.notify_one();
+    }
+    if (writer.joinable()) {
+        writer.join();
+    }
+}
+
+// Method to queue a record; never blocks on I/O
+void Logger::log(LogLevel level, const string& text) {
+    if (level < this->level.load(memory_order_relaxed)) {
+        return;
+    }
+    size_t pos = head.load(memory_order_relaxed);
+    Slot* slot;
+    while (true) {
+        slot = &slots[pos & mask];
+        size_t seq = slot->seq.load(memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (head.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            dropped_count.fetch_add(1, memory_order_relaxed);
+            return;
+        } else {
+            pos = head.load(memory_order_relaxed);
+        }
+    }
+    slot->record.level = level;
+    slot->record.time = chrono::system_clock::now();
+    slot->record.text = text;
+    slot->seq.store(pos + 1, memory_order_release);
+
+    // Only an idle writer needs a wakeup; a busy one finds the record itself
+    if (sleeping.load(memory_order_acquire)) {
+        wake_cv.notify_one();
+    }
+}
+
+// Method to get the number of records lost to a full ring
+uint64_t Logger::dropped() const {
+    return dropped_count.load(memory_order_relaxed);
+}
+
+// Method to get the next record in the ring, null if it is empty
+Logger::Record* Logger::front() {
+    Slot& slot = slots[tail & mask];
+    if (slot.seq.load(memory_order_acquire) != tail + 1) {
+        return nullptr;
+    }
+    return &slot.record;
+}
+
+// Method to hand the slot of front() back to the producers
+void Logger::pop() {
+    Slot& slot = slots[tail & mask];
+    // An oversized message must not pin its buffer in the ring forever
+    if (slot.record.text.capacity() > SLOT_CAPACITY) {
+        string().swap(slot.record.text);
+    }
+    slot.seq.store(tail + mask + 1, memory_order_release);
+    tail++;
+}
+
+// Method to run the writer loop
+void Logger::run() {
+    while (true) {
+        if (drain()) {
+            continue;
+        }
+        if (!running) {
+            drain();
+            return;
+        }
+        // The timeout covers a producer that checked sleeping just before it
+        // was set; it bounds the extra latency, not the throughput
+        unique_lock<mutex> lock(wake_mtx);
+        sleeping.store(true, memory_order_release);
+        wake_cv.wait_for(lock, chrono::milliseconds(10));
+        sleeping.store(false, memory_order_release);
+    }
+}
+
+// Method to format and write everything currently in the ring
+bool Logger::drain() {
+    Record* next;
+    size_t count = 0;
+
+    console_out.clear();
+    file_out.clear();
+    while (count < MAX_BATCH && (next = front())) {
+        const Record& record = *next;
+        count++;
+        time_t seconds = chrono::system_clock::to_time_t(record.time);
+        long millis = chrono::duration_cast<chrono::milliseconds>(
+                          record.time.time_since_epoch()).count() % 1000;
+        tm local;
+        localtime_r(&seconds, &local);
+        char prefix[48];
+        snprintf(prefix, sizeof(prefix), "%02d:%02d:%02d.%03ld %s ",
+                 local.tm_hour, local.tm_min, local.tm_sec, millis, level_names[record.level]);
+
+        if (console) {
+            if (color) {
+                console_out += level_colors[record.level];
+                console_out += prefix;
+                console_out += "\033[0m";
+                console_out += record.text;
+                console_out += "\033[0m";
+            } else {
+                console_out += prefix;
+                append_plain(console_out, record.text);
+            }
+            console_out += '\n';
+        }
+        if (file_fd != -1) {
+            file_out += prefix;
+            append_plain(file_out, record.text);
+            file_out += '\n';
+        }
+        pop();
+    }
+
+    if (!console_out.empty()) {
+        write_all(STDOUT_FILENO, console_out);
+    }
+    if (!file_out.empty()) {
+        write_all(file_fd, file_out);
+    }
+    return count > 0;
+}
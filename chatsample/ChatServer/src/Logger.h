@@ -0,0 +1,97 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+enum LogLevel {
+    LOG_DEBUG,
+    LOG_INFO,
+    LOG_WARN,
+    LOG_ERROR
+};
+
+// Asynchronous logger. Producers push records into a bounded lock-free
+// MPSC ring and return at once; a background thread formats them and writes
+// each batch with one write() per sink. When the ring is full the record is
+// dropped and counted instead of blocking the producer. Records are copied
+// into strings that stay in their slots, so once every slot has been used
+// logging no longer allocates.
+class Logger {
+public:
+    // Constructor to create a logger whose ring holds capacity records
+    // (rounded up to a power of two)
+    explicit Logger(size_t capacity = 65536);
+
+    // Destructor to flush every queued record and stop the writer thread
+    ~Logger();
+
+    // Methods to configure the logger; call before start()
+    void set_level(LogLevel level);
+    void set_color(bool enabled);
+    void set_console(bool enabled);
+    bool open_file(const string& path);
+
+    // Method to start the background writer thread
+    void start();
+
+    // Method to drain the ring and stop the writer thread
+    void stop();
+
+    // Method to queue a record; never blocks on I/O
+    void log(LogLevel level, const string& text);
+
+    // Method to get the number of records lost to a full ring
+    uint64_t dropped() const;
+
+private:
+    struct Record {
+        LogLevel level;
+        chrono::system_clock::time_point time;
+        string text;
+    };
+
+    struct Slot {
+        atomic<size_t> seq;     // Tells producers and consumer whose turn it is
+        Record record;
+    };
+
+    vector<Slot> slots;         // Ring storage
+    size_t mask;                // slots.size() - 1
+    atomic<size_t> head;        // Next position producers claim
+    size_t tail;                // Next position the writer reads
+    atomic<LogLevel> level;     // Records below this level are ignored
+    bool color;                 // Keep ANSI colors on the console
+    bool console;               // Write to stdout
+    int file_fd;                // File sink, -1 if none
+    atomic<bool> running;       // Writer thread keeps going while set
+    atomic<bool> sleeping;      // Writer thread is waiting for records
+    atomic<uint64_t> dropped_count; // Records lost to a full ring
+    mutex wake_mtx;             // Mutex paired with wake_cv
+    condition_variable wake_cv; // Wakes an idle writer thread
+    thread writer;              // Background writer thread
+    string console_out;         // Writer thread: console batch being built
+    string file_out;            // Writer thread: file batch being built
+
+    // Method to get the next record in the ring, null if it is empty
+    Record* front();
+
+    // Method to hand the slot of front() back to the producers
+    void pop();
+
+    // Method to run the writer loop
+    void run();
+
+    // Method to format and write everything currently in the ring
+    bool drain();
+};
+
+#endif // LOGGER_H
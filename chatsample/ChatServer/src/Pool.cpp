@@ -0,0 +1,130 @@
+#include "Pool.h"
+
+#include <mutex>
+#include <new>
+
+static const int MIN_SHIFT = 6;                 // Smallest class: 64 bytes
+static const int NUM_CLASSES = 15;              // Up to 1 MiB
+static const size_t HEADER = 16;                // Keeps blocks 16-byte aligned
+static const uint32_t LARGE = NUM_CLASSES;      // Class of unpooled blocks
+
+// Link stored in the first words of a free block
+struct FreeBlock {
+    FreeBlock* next;        // Next block in the same list or batch
+    FreeBlock* next_batch;  // Depot only: first block of the next batch
+};
+
+// Shared depot of whole batches, one list per class
+struct Depot {
+    mutex mtx;
+    FreeBlock* batches;
+};
+
+static Depot depots[NUM_CLASSES];
+
+// Method to get the number of blocks a thread keeps per class; large
+// classes keep fewer so an idle thread does not sit on megabytes
+static size_t local_limit(int cls) {
+    size_t limit = (size_t(1) << 22) >> (cls + MIN_SHIFT);
+    return limit < 4 ? 4 : (limit > 128 ? 128 : limit);
+}
+
+// Per-thread free lists; whatever is left goes to the depot at thread exit
+struct ThreadCache {
+    FreeBlock* heads[NUM_CLASSES];
+    size_t counts[NUM_CLASSES];
+
+    ThreadCache() {
+        for (int i = 0; i < NUM_CLASSES; i++) {
+            heads[i] = nullptr;
+            counts[i] = 0;
+        }
+    }
+
+    ~ThreadCache() {
+        for (int i = 0; i < NUM_CLASSES; i++) {
+            if (heads[i]) {
+                push_batch(i, heads[i]);
+            }
+        }
+    }
+
+    // Method to hand a chain of blocks to the depot
+    static void push_batch(int cls, FreeBlock* batch) {
+        lock_guard<mutex> guard(depots[cls].mtx);
+        batch->next_batch = depots[cls].batches;
+        depots[cls].batches = batch;
+    }
+
+    // Method to take a chain of blocks from the depot, null if it is empty
+    static FreeBlock* pop_batch(int cls) {
+        lock_guard<mutex> guard(depots[cls].mtx);
+        FreeBlock* batch = depots[cls].batches;
+        if (batch) {
+            depots[cls].batches = batch->next_batch;
+        }
+        return batch;
+    }
+};
+
+static thread_local ThreadCache cache;
+
+// Method to get a block of at least bytes
+void* BufferPool::allocate(size_t bytes) {
+    size_t total = bytes + HEADER;
+    int cls = 0;
+    while (cls < NUM_CLASSES && (size_t(1) << (cls + MIN_SHIFT)) < total) {
+        cls++;
+    }
+
+    char* block;
+    if (cls == NUM_CLASSES) {
+        block = static_cast<char*>(::operator new(total));
+    } else if (cache.heads[cls]) {
+        FreeBlock* head = cache.heads[cls];
+        cache.heads[cls] = head->next;
+        cache.counts[cls]--;
+        block = reinterpret_cast<char*>(head);
+    } else if (FreeBlock* batch = ThreadCache::pop_batch(cls)) {
+        // Keep the rest of the batch locally
+        size_t count = 0;
+        for (FreeBlock* b = batch->next; b; b = b->next) {
+            count++;
+        }
+        cache.heads[cls] = batch->next;
+        cache.counts[cls] = count;
+        block = reinterpret_cast<char*>(batch);
+    } else {
+        block = static_cast<char*>(::operator new(size_t(1) << (cls + MIN_SHIFT)));
+    }
+    *reinterpret_cast<uint32_t*>(block) = cls == NUM_CLASSES ? LARGE : static_cast<uint32_t>(cls);
+    return block + HEADER;
+}
+
+// Method to return a block from allocate(), from any thread
+void BufferPool::release(void* pointer) {
+    char* block = static_cast<char*>(pointer) - HEADER;
+    uint32_t cls = *reinterpret_cast<uint32_t*>(block);
+    if (cls == LARGE) {
+        ::operator delete(block);
+        return;
+    }
+
+    FreeBlock* free_block = reinterpret_cast<FreeBlock*>(block);
+    free_block->next = cache.heads[cls];
+    cache.heads[cls] = free_block;
+    size_t limit = local_limit(cls);
+    if (++cache.counts[cls] < limit) {
+        return;
+    }
+    // Move the older half to the depot for threads that allocate more than
+    // they free (the sender's reactor in a broadcast)
+    FreeBlock* last = cache.heads[cls];
+    for (size_t i = 1; i < limit / 2; i++) {
+        last = last->next;
+    }
+    FreeBlock* batch = last->next;
+    last->next = nullptr;
+    cache.counts[cls] = limit / 2;
+    ThreadCache::push_batch(cls, batch);
+}
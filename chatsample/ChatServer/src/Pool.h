@@ -0,0 +1,119 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <vector>
+
+using namespace std;
+
+// Single-threaded pool of reusable objects. Released objects keep their
+// members (and the capacity of their strings and vectors) for the next
+// acquire(); every object ever handed out is owned by the pool and freed
+// with it.
+template <typename T>
+class ObjectPool {
+public:
+    // Method to take an object, creating one only when none is idle
+    T* acquire() {
+        if (idle.empty()) {
+            all.emplace_back(new T());
+            return all.back().get();
+        }
+        T* object = idle.back();
+        idle.pop_back();
+        return object;
+    }
+
+    // Method to give an object back; the caller resets what it needs
+    void release(T* object) {
+        idle.push_back(object);
+    }
+
+private:
+    vector<unique_ptr<T>> all;  // Every object created by this pool
+    vector<T*> idle;            // Objects ready for reuse
+};
+
+// Size-classed pool of raw blocks, from 64 bytes to 1 MiB in powers of two.
+// Every thread keeps its own free list per class, so the common allocate
+// and release touch no lock; when a list grows past its limit half of it
+// moves to a shared depot, where threads that mostly allocate pick it up.
+// Larger requests go straight to operator new.
+class BufferPool {
+public:
+    // Method to get a block of at least bytes
+    static void* allocate(size_t bytes);
+
+    // Method to return a block from allocate(), from any thread
+    static void release(void* block);
+};
+
+// Immutable byte buffer with an atomic reference count, allocated from
+// BufferPool. Copies share the bytes; the last one releases the block.
+class SharedBuffer {
+public:
+    SharedBuffer() : rep(nullptr) {}
+
+    SharedBuffer(const SharedBuffer& other) : rep(other.rep) {
+        if (rep) {
+            rep->refs.fetch_add(1, memory_order_relaxed);
+        }
+    }
+
+    SharedBuffer(SharedBuffer&& other) : rep(other.rep) {
+        other.rep = nullptr;
+    }
+
+    ~SharedBuffer() {
+        reset();
+    }
+
+    SharedBuffer& operator=(SharedBuffer other) {
+        swap(rep, other.rep);
+        return *this;
+    }
+
+    // Method to create a buffer of size bytes; fill it through data()
+    // before sharing it
+    static SharedBuffer allocate(size_t size) {
+        SharedBuffer buffer;
+        buffer.rep = static_cast<Rep*>(BufferPool::allocate(sizeof(Rep) + size));
+        new (&buffer.rep->refs) atomic<int>(1);
+        buffer.rep->size = size;
+        return buffer;
+    }
+
+    // Method to drop this reference
+    void reset() {
+        if (rep && rep->refs.fetch_sub(1, memory_order_acq_rel) == 1) {
+            BufferPool::release(rep);
+        }
+        rep = nullptr;
+    }
+
+    char* data() {
+        return reinterpret_cast<char*>(rep + 1);
+    }
+
+    const char* data() const {
+        return reinterpret_cast<const char*>(rep + 1);
+    }
+
+    size_t size() const {
+        return rep->size;
+    }
+
+private:
+    struct Rep {
+        atomic<int> refs;
+        uint32_t size;
+    };
+
+    Rep* rep;   // Header of the block, the bytes follow it
+};
+
+#endif // POOL_H
@@ -0,0 +1,179 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+using namespace std;
+
+// Wire format shared by ChatServer and ChatClient. Every message travels as
+// one frame, all integers in network byte order:
+//
+//   uint32 length     bytes that follow this field
+//   uint8  version    PROTOCOL_VERSION
+//   uint8  type       FRAME_*
+//   int32  sender id
+//   uint16 name length
+//   name bytes, then payload bytes up to the end of the frame
+
+#define PROTOCOL_VERSION 1
+#define FRAME_HEADER_LEN 12         // Fixed part including the length field
+#define FRAME_MAX_LEN (64 * 1024)   // Default largest accepted value of length
+#define FRAME_LIMIT_LEN (UINT32_MAX - FRAME_HEADER_LEN) // Highest max_len a decoder takes
+
+enum FrameType : uint8_t {
+    FRAME_HELLO = 1,    // Client -> server: name of the new user
+    FRAME_CHAT = 2,     // Chat message (client -> server, server -> clients)
+    FRAME_SYSTEM = 3,   // Server notice such as join or leave
+    FRAME_PING = 4,     // Server -> client: liveness probe after a silence
+    FRAME_PONG = 5      // Client -> server: answer to a ping
+};
+
+struct Frame {
+    uint8_t type;
+    int32_t sender_id;
+    string name;
+    string payload;
+};
+
+// Method to get the encoded size of a frame
+inline size_t frame_size(size_t name_len, size_t payload_len) {
+    return FRAME_HEADER_LEN + name_len + payload_len;
+}
+
+// Method to serialize a frame into frame_size() bytes at out
+inline void encode_frame_into(char* out, uint8_t type, int32_t sender_id, const string& name, const string& payload) {
+    uint32_t length = htonl(static_cast<uint32_t>(frame_size(name.size(), payload.size()) - 4));
+    uint32_t id = htonl(static_cast<uint32_t>(sender_id));
+    uint16_t name_len = htons(static_cast<uint16_t>(name.size()));
+    memcpy(out, &length, 4);
+    out[4] = PROTOCOL_VERSION;
+    out[5] = static_cast<char>(type);
+    memcpy(out + 6, &id, 4);
+    memcpy(out + 10, &name_len, 2);
+    memcpy(out + FRAME_HEADER_LEN, name.data(), name.size());
+    memcpy(out + FRAME_HEADER_LEN + name.size(), payload.data(), payload.size());
+}
+
+// Method to serialize a frame; the result is sent as is to every recipient
+inline string encode_frame(uint8_t type, int32_t sender_id, const string& name, const string& payload) {
+    string out(frame_size(name.size(), payload.size()), '\0');
+    encode_frame_into(&out[0], type, sender_id, name, payload);
+    return out;
+}
+
+// Methods to read the type of an already encoded frame
+inline uint8_t frame_type(const char* encoded) {
+    return static_cast<uint8_t>(encoded[5]);
+}
+
+inline uint8_t frame_type(const string& encoded) {
+    return frame_type(encoded.data());
+}
+
+// Incremental parser: feed() whatever recv() returned, then call next()
+// until it returns false. A partial frame stays buffered across calls; the
+// buffer grows to the size announced in its header and is given back once
+// the frame is complete, so idle connections hold no read memory.
+class FrameDecoder {
+public:
+    explicit FrameDecoder(size_t max_len = FRAME_MAX_LEN)
+        : offset(0), max_len(max_len), failed(false), oversized(false) {}
+
+    // Method to make the decoder fresh for a new connection, keeping a
+    // small buffer for reuse
+    void reset(size_t max_len) {
+        if (buf.capacity() > IDLE_CAPACITY) {
+            string().swap(buf);
+        }
+        buf.clear();
+        offset = 0;
+        this->max_len = max_len;
+        failed = false;
+        oversized = false;
+    }
+
+    // Method to append received bytes
+    void feed(const char* data, size_t len) {
+        buf.append(data, len);
+    }
+
+    // Method to extract the next complete frame, false if none is buffered
+    bool next(Frame& frame) {
+        if (failed || buf.size() - offset < FRAME_HEADER_LEN) {
+            compact();
+            return false;
+        }
+        const char* p = buf.data() + offset;
+        uint32_t length;
+        uint32_t id;
+        uint16_t name_len;
+        memcpy(&length, p, 4);
+        memcpy(&id, p + 6, 4);
+        memcpy(&name_len, p + 10, 2);
+        length = ntohl(length);
+        name_len = ntohs(name_len);
+        if (static_cast<uint8_t>(p[4]) != PROTOCOL_VERSION || length < static_cast<uint32_t>(FRAME_HEADER_LEN - 4) + name_len) {
+            failed = true;
+            return false;
+        }
+        // Checked from the header alone, before any of the body is buffered
+        if (length > max_len) {
+            failed = true;
+            oversized = true;
+            return false;
+        }
+        // In size_t, so a length near UINT32_MAX cannot wrap around
+        size_t total = static_cast<size_t>(length) + 4;
+        if (buf.size() - offset < total) {
+            compact();
+            buf.reserve(total);
+            return false;
+        }
+        frame.type = static_cast<uint8_t>(p[5]);
+        frame.sender_id = static_cast<int32_t>(ntohl(id));
+        frame.name.assign(p + FRAME_HEADER_LEN, name_len);
+        frame.payload.assign(p + FRAME_HEADER_LEN + name_len, total - FRAME_HEADER_LEN - name_len);
+        offset += total;
+        return true;
+    }
+
+    // Method to get the received bytes not yet returned as frames
+    string pending() const {
+        return buf.substr(offset);
+    }
+
+    // Method to check whether the stream carried a malformed frame
+    bool error() const {
+        return failed;
+    }
+
+    // Method to check whether the error was a frame above max_len
+    bool too_large() const {
+        return oversized;
+    }
+
+private:
+    static const size_t IDLE_CAPACITY = 4096; // Kept between frames
+
+    string buf;         // Received bytes
+    size_t offset;      // Start of the first unparsed frame in buf
+    size_t max_len;     // Largest accepted value of the length field
+    bool failed;        // Set on a bad version or length
+    bool oversized;     // Set when failed because of max_len
+
+    // Method to drop consumed bytes once no complete frame is left
+    void compact() {
+        if (offset == buf.size() && buf.capacity() > IDLE_CAPACITY) {
+            string().swap(buf);
+            offset = 0;
+        } else if (offset > 0) {
+            buf.erase(0, offset);
+            offset = 0;
+        }
+    }
+};
+
+#endif // PROTOCOL_H
@@ -0,0 +1,83 @@
+#ifndef RINGQUEUE_H
+#define RINGQUEUE_H
+
+#include <stddef.h>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// FIFO queue on a power-of-two circular array. Unlike deque it never frees
+// or allocates while its size stays below the largest size it has reached,
+// so a connection's output queue costs no allocation once it is warm.
+template <typename T>
+class RingQueue {
+public:
+    RingQueue() : head(0), count(0) {}
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    T& front() {
+        return slots[head];
+    }
+
+    // Method to access the element i positions after the front
+    T& operator[](size_t i) {
+        return slots[(head + i) & (slots.size() - 1)];
+    }
+
+    void push_back(const T& value) {
+        if (count == slots.size()) {
+            grow();
+        }
+        (*this)[count] = value;
+        count++;
+    }
+
+    void pop_front() {
+        slots[head] = T();
+        head = (head + 1) & (slots.size() - 1);
+        count--;
+    }
+
+    // Method to remove n elements starting at position pos
+    void erase(size_t pos, size_t n) {
+        for (size_t i = pos; i + n < count; i++) {
+            (*this)[i] = move((*this)[i + n]);
+        }
+        for (size_t i = count - n; i < count; i++) {
+            (*this)[i] = T();
+        }
+        count -= n;
+    }
+
+    void clear() {
+        while (count > 0) {
+            pop_front();
+        }
+        head = 0;
+    }
+
+private:
+    vector<T> slots;    // Storage, size is zero or a power of two
+    size_t head;        // Index of the front element
+    size_t count;       // Number of queued elements
+
+    // Method to double the storage, moving the front to index 0
+    void grow() {
+        vector<T> bigger(slots.empty() ? 8 : slots.size() * 2);
+        for (size_t i = 0; i < count; i++) {
+            bigger[i] = move((*this)[i]);
+        }
+        slots.swap(bigger);
+        head = 0;
+    }
+};
+
+#endif // RINGQUEUE_H
@@ -0,0 +1,169 @@
+#include "TimerWheel.h"
+
+// Method to move every node of head onto batch, leaving head empty
+static void detach(TimerWheel::Link* head, TimerWheel::Link& batch) {
+    if (head->next == head) {
+        batch.prev = batch.next = &batch;
+        return;
+    }
+    batch.next = head->next;
+    batch.prev = head->prev;
+    batch.next->prev = &batch;
+    batch.prev->next = &batch;
+    head->prev = head->next = head;
+}
+
+TimerWheel::TimerWheel(uint64_t now) : current(now), count(0) {
+    for (int level = 0; level < LEVELS; level++) {
+        for (int slot = 0; slot < SLOTS; slot++) {
+            slots[level][slot].prev = slots[level][slot].next = &slots[level][slot];
+        }
+        occupied[level] = 0;
+    }
+    ready.prev = ready.next = &ready;
+}
+
+// Method to (re)schedule a timer to fire at tick expires
+void TimerWheel::schedule(Timer* timer, uint64_t expires) {
+    if (expires <= current) {
+        defer(timer);
+        return;
+    }
+    cancel(timer);
+    timer->expires = expires;
+    place(timer);
+    count++;
+}
+
+// Method to (re)schedule a timer to run at the next advance()
+void TimerWheel::defer(Timer* timer) {
+    cancel(timer);
+    timer->level = LEVELS;
+    push(&ready, timer);
+    count++;
+}
+
+// Method to unschedule a timer
+void TimerWheel::cancel(Timer* timer) {
+    if (timer->pending()) {
+        unlink(timer);
+    }
+}
+
+// Method to move time forward to tick now and run every timer due by then
+void TimerWheel::advance(uint64_t now) {
+    run(&ready);
+    while (current < now) {
+        // Ticks without a slot to run or cascade are skipped in one step
+        int64_t wait = next_timeout();
+        if (wait < 0 || static_cast<uint64_t>(wait) > now - current) {
+            current = now;
+            break;
+        }
+        current += wait;
+        for (int level = 1; level < LEVELS; level++) {
+            int shift = SLOT_BITS * level;
+            if (current & ((uint64_t(1) << shift) - 1)) {
+                break;
+            }
+            cascade(level, (current >> shift) & SLOT_MASK);
+        }
+        size_t slot = current & SLOT_MASK;
+        occupied[0] &= ~(uint64_t(1) << slot);
+        run(&slots[0][slot]);
+        // Work deferred by those callbacks runs before the next tick
+        run(&ready);
+    }
+}
+
+// Method to get the ticks until a timer may be due
+int64_t TimerWheel::next_timeout() const {
+    if (ready.next != &ready) {
+        return 0;
+    }
+    int64_t best = -1;
+    for (int level = 0; level < LEVELS; level++) {
+        uint64_t bits = occupied[level];
+        if (bits == 0) {
+            continue;
+        }
+        // Nearest occupied slot after the current position; a slot comes
+        // due (level 0) or moves down (upper levels) at the start of its span
+        int shift = SLOT_BITS * level;
+        uint64_t pos = current >> shift;
+        unsigned from = (pos + 1) & SLOT_MASK;
+        uint64_t rotated = from ? (bits >> from) | (bits << (SLOTS - from)) : bits;
+        uint64_t tick = (pos + 1 + __builtin_ctzll(rotated)) << shift;
+        int64_t wait = static_cast<int64_t>(tick - current);
+        if (best < 0 || wait < best) {
+            best = wait;
+        }
+    }
+    return best;
+}
+
+// Method to append a timer to a list
+void TimerWheel::push(Link* head, Timer* timer) {
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+// Method to take a timer out of its list and the count
+void TimerWheel::unlink(Timer* timer) {
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = timer->next = nullptr;
+    count--;
+    if (timer->level < LEVELS) {
+        Link* head = &slots[timer->level][timer->slot];
+        if (head->next == head) {
+            occupied[timer->level] &= ~(uint64_t(1) << timer->slot);
+        }
+    }
+}
+
+// Method to put a linked-out timer into the slot matching its expiry
+void TimerWheel::place(Timer* timer) {
+    // Level l holds deadlines less than 64^(l+1) ticks away, in slots as
+    // wide as 64^l ticks
+    uint64_t delta = timer->expires > current ? timer->expires - current : 0;
+    if (delta > HORIZON) {
+        timer->expires = current + HORIZON;
+        delta = HORIZON;
+    }
+    int level = 0;
+    while (delta >> (SLOT_BITS * (level + 1))) {
+        level++;
+    }
+    size_t slot = (timer->expires >> (SLOT_BITS * level)) & SLOT_MASK;
+    timer->level = static_cast<uint8_t>(level);
+    timer->slot = static_cast<uint8_t>(slot);
+    push(&slots[level][slot], timer);
+    occupied[level] |= uint64_t(1) << slot;
+}
+
+// Method to spread one slot of an upper level over the lower ones
+void TimerWheel::cascade(int level, size_t slot) {
+    Link batch;
+    detach(&slots[level][slot], batch);
+    occupied[level] &= ~(uint64_t(1) << slot);
+    while (batch.next != &batch) {
+        Timer* timer = static_cast<Timer*>(batch.next);
+        batch.next = timer->next;
+        timer->next->prev = &batch;
+        place(timer);
+    }
+}
+
+// Method to run every timer of a list
+void TimerWheel::run(Link* head) {
+    Link batch;
+    detach(head, batch);
+    while (batch.next != &batch) {
+        Timer* timer = static_cast<Timer*>(batch.next);
+        unlink(timer);
+        timer->callback();
+    }
+}
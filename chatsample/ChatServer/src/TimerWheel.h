@@ -0,0 +1,106 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <stdint.h>
+#include <functional>
+
+using namespace std;
+
+// Hierarchical timing wheel: four levels of 64 slots, so with millisecond
+// ticks it reaches about 4.6 hours ahead; later deadlines fire at that
+// horizon. Timers are nodes embedded in their owner, which makes
+// scheduling, re-arming and cancelling O(1) list splices that never
+// allocate. Each level keeps a bitmap of its non-empty slots, so the time
+// to the next expiry is found in O(1) as well. A timer moves down a level
+// at most three times before it fires.
+//
+// Not thread-safe: the event loop that owns a wheel is its only user.
+class TimerWheel {
+public:
+    // Struct to link a timer into a slot list
+    struct Link {
+        Link* prev;
+        Link* next;
+    };
+
+    // Timer embedded in its owner; the owner keeps it alive while pending
+    struct Timer : Link {
+        uint64_t expires;           // Tick at which it fires
+        uint8_t level;              // Wheel level holding it, LEVELS if ready
+        uint8_t slot;               // Slot in that level
+        function<void()> callback;  // Run by advance() once due
+
+        Timer() : expires(0), level(0), slot(0) {
+            prev = next = nullptr;
+        }
+
+        bool pending() const {
+            return next != nullptr;
+        }
+    };
+
+    explicit TimerWheel(uint64_t now = 0);
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // Method to (re)schedule a timer to fire at tick expires; a tick that
+    // has already passed makes it ready like defer()
+    void schedule(Timer* timer, uint64_t expires);
+
+    // Method to (re)schedule a timer to run at the next advance() without
+    // waiting for a tick, e.g. work deferred to the end of a loop round
+    void defer(Timer* timer);
+
+    // Method to unschedule a timer; nothing happens if it is not pending
+    void cancel(Timer* timer);
+
+    // Method to move time forward to tick now and run every timer that is
+    // ready or due by then. Callbacks may schedule and cancel any timer
+    void advance(uint64_t now);
+
+    // Method to get the ticks until a timer may be due: 0 if some are
+    // ready, -1 if none is pending. A deadline on an upper level reports
+    // when it moves down, which is never after it is due
+    int64_t next_timeout() const;
+
+    // Method to get the last tick advance() reached
+    uint64_t now() const {
+        return current;
+    }
+
+    // Method to get the number of pending timers
+    size_t size() const {
+        return count;
+    }
+
+private:
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 6;
+    static const int SLOTS = 1 << SLOT_BITS;
+    static const uint64_t SLOT_MASK = SLOTS - 1;
+    static const uint64_t HORIZON = (uint64_t(1) << (SLOT_BITS * LEVELS)) - 1;
+
+    uint64_t current;               // Last tick processed
+    size_t count;                   // Pending timers, ready ones included
+    Link slots[LEVELS][SLOTS];      // Sentinels of the slot lists
+    uint64_t occupied[LEVELS];      // Bit s set while slots[level][s] is non-empty
+    Link ready;                     // Sentinel of the timers due right away
+
+    // Method to append a timer to a list
+    static void push(Link* head, Timer* timer);
+
+    // Method to take a timer out of its list and the count
+    void unlink(Timer* timer);
+
+    // Method to put a linked-out timer into the slot matching its expiry
+    void place(Timer* timer);
+
+    // Method to spread one slot of an upper level over the lower ones
+    void cascade(int level, size_t slot);
+
+    // Method to run every timer of a list, detached first so callbacks
+    // may reschedule freely
+    void run(Link* head);
+};
+
+#endif // TIMERWHEEL_H
@@ -0,0 +1,214 @@
+#include "Uring.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+
+static int io_uring_setup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+
+Uring::Uring()
+    : ring_fd(-1), sq_pending(0), sq_ptr(MAP_FAILED), sq_size(0), sqes(nullptr), sqes_size(0),
+      cq_ptr(MAP_FAILED), cq_size(0), buf_base(nullptr), buf_count(0), buf_size(0) {}
+
+Uring::~Uring() {
+    if (sqes) {
+        munmap(sqes, sqes_size);
+    }
+    if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr) {
+        munmap(cq_ptr, cq_size);
+    }
+    if (sq_ptr != MAP_FAILED) {
+        munmap(sq_ptr, sq_size);
+    }
+    if (ring_fd != -1) {
+        close(ring_fd);
+    }
+    // Freed last: the kernel may own some of it until the ring is closed
+    delete[] buf_base;
+}
+
+// Method to check whether the running kernel has everything we use
+// (multishot accept and recv, provided buffers)
+bool Uring::supported() {
+    // Multishot recv arrived last, in 6.0; older kernels reject it per request
+    utsname name;
+    int major = 0, minor = 0;
+    if (uname(&name) != 0 || sscanf(name.release, "%d.%d", &major, &minor) != 2 || major < 6) {
+        return false;
+    }
+    Uring probe;
+    return probe.init(8, 8, 64);
+}
+
+// Method to create the rings; false if the kernel refuses
+bool Uring::init(unsigned entries, unsigned buf_count, unsigned buf_size) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    if ((ring_fd = io_uring_setup(entries, &params)) == -1) {
+        return false;
+    }
+
+    sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        sq_size = cq_size = max(sq_size, cq_size);
+    }
+    sq_ptr = mmap(nullptr, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ptr == MAP_FAILED) {
+        return false;
+    }
+    cq_ptr = single_mmap ? sq_ptr
+                         : mmap(nullptr, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                ring_fd, IORING_OFF_CQ_RING);
+    if (cq_ptr == MAP_FAILED) {
+        return false;
+    }
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes_ptr = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ring_fd, IORING_OFF_SQES);
+    if (sqes_ptr == MAP_FAILED) {
+        return false;
+    }
+    sqes = static_cast<io_uring_sqe*>(sqes_ptr);
+
+    char* sq = static_cast<char*>(sq_ptr);
+    sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    char* cq = static_cast<char*>(cq_ptr);
+    cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    // Provided buffers go through IORING_OP_PROVIDE_BUFFERS rather than a
+    // registered buffer ring, which is not dependable on every 6.x kernel
+    this->buf_count = buf_count;
+    this->buf_size = buf_size;
+    buf_base = new char[static_cast<size_t>(buf_count) * buf_size];
+    prep_provide_buffers(0, buf_count);
+    if (submit() != 1) {
+        return false;
+    }
+    io_uring_enter(ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+    unsigned head = *cq_head;
+    if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE) || cqes[head & *cq_mask].res < 0) {
+        return false;
+    }
+    __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Method to get the ring descriptor; it polls readable with completions
+int Uring::fd() const {
+    return ring_fd;
+}
+
+// Methods to queue operations
+void Uring::prep_accept_multishot(int fd, uint64_t user_data) {
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = user_data;
+}
+
+void Uring::prep_recv_multishot(int fd, uint64_t user_data) {
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->user_data = user_data;
+}
+
+void Uring::prep_sendmsg(int fd, const msghdr* msg, uint64_t user_data) {
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = user_data;
+}
+
+void Uring::prep_cancel(uint64_t target) {
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = URING_INTERNAL;
+}
+
+// Method to submit every queued SQE with one system call
+int Uring::submit() {
+    if (sq_pending == 0) {
+        return 0;
+    }
+    int n;
+    do {
+        n = io_uring_enter(ring_fd, sq_pending, 0, 0);
+    } while (n == -1 && errno == EINTR);
+    if (n == -1) {
+        perror("io_uring_enter: ");
+        return -1;
+    }
+    sq_pending -= static_cast<unsigned>(n);
+    return n;
+}
+
+// Method to get the bytes of a provided buffer picked by the kernel
+const char* Uring::buffer(uint16_t bid) const {
+    return buf_base + static_cast<size_t>(bid) * buf_size;
+}
+
+// Method to give a provided buffer back to the kernel; it goes out with
+// the next submit()
+void Uring::recycle(uint16_t bid) {
+    // Only a failure posts a completion, and drain() skips it
+    prep_provide_buffers(bid, 1)->flags = IOSQE_CQE_SKIP_SUCCESS;
+}
+
+// Method to take a free SQE, submitting first if the ring is full
+io_uring_sqe* Uring::get_sqe() {
+    unsigned tail = *sq_tail;
+    if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) > *sq_mask) {
+        submit();
+    }
+    unsigned index = tail & *sq_mask;
+    io_uring_sqe* sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array[index] = index;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    sq_pending++;
+    return sqe;
+}
+
+// Method to queue handing count buffers starting at bid to the kernel
+io_uring_sqe* Uring::prep_provide_buffers(uint16_t bid, unsigned count) {
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = static_cast<int>(count);
+    sqe->addr = reinterpret_cast<uint64_t>(buffer(bid));
+    sqe->len = buf_size;
+    sqe->off = bid;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->user_data = URING_INTERNAL;
+    return sqe;
+}
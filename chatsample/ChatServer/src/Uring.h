@@ -0,0 +1,107 @@
+#ifndef URING_H
+#define URING_H
+
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <stdint.h>
+
+using namespace std;
+
+#define URING_BUF_GROUP 0   // Buffer group id used by recv
+#define URING_INTERNAL 0    // user_data of the ring's own requests
+
+// Minimal io_uring wrapper on top of the raw system calls: one submission
+// and completion ring plus one group of provided receive buffers. SQEs are
+// only queued by the prep_* methods; submit() hands all of them to the
+// kernel with a single io_uring_enter.
+class Uring {
+public:
+    Uring();
+    ~Uring();
+
+    // Method to check whether the running kernel has everything we use
+    // (multishot accept and recv, provided buffers)
+    static bool supported();
+
+    // Method to create the rings; false if the kernel refuses
+    bool init(unsigned entries, unsigned buf_count, unsigned buf_size);
+
+    // Method to get the ring descriptor; it polls readable with completions
+    int fd() const;
+
+    // Methods to queue operations
+    void prep_accept_multishot(int fd, uint64_t user_data);
+    void prep_recv_multishot(int fd, uint64_t user_data);
+    void prep_sendmsg(int fd, const msghdr* msg, uint64_t user_data);
+
+    // Method to queue cancelling the request tagged target; it completes
+    // with -ECANCELED (a send may instead report what it already sent)
+    void prep_cancel(uint64_t target);
+
+    // Method to submit every queued SQE with one system call
+    int submit();
+
+    // Method to call fn(cqe) for at most max available completions;
+    // completions of the ring's own buffer bookkeeping are skipped. The rest
+    // wait for the next call, so a busy stream cannot hold back submit()
+    template <typename F>
+    unsigned drain(F fn, unsigned max) {
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        unsigned count = 0;
+        while (head != tail && count < max) {
+            io_uring_cqe cqe = cqes[head & *cq_mask];
+            head++;
+            count++;
+            // Publish progress first: the handler may queue and submit more
+            __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+            if (cqe.user_data != URING_INTERNAL) {
+                fn(cqe);
+            }
+        }
+        return count;
+    }
+
+    // Method to get the bytes of a provided buffer picked by the kernel
+    const char* buffer(uint16_t bid) const;
+
+    // Method to give a provided buffer back to the kernel; it goes out with
+    // the next submit()
+    void recycle(uint16_t bid);
+
+private:
+    int ring_fd;
+    unsigned sq_pending;            // Queued SQEs not yet submitted
+
+    // Submission ring
+    void* sq_ptr;
+    size_t sq_size;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    io_uring_sqe* sqes;
+    size_t sqes_size;
+
+    // Completion ring
+    void* cq_ptr;
+    size_t cq_size;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    io_uring_cqe* cqes;
+
+    // Provided buffers for multishot recv
+    char* buf_base;
+    unsigned buf_count;
+    unsigned buf_size;
+
+    // Method to take a free SQE, submitting first if the ring is full
+    io_uring_sqe* get_sqe();
+
+    // Method to queue handing count buffers starting at bid to the kernel
+    io_uring_sqe* prep_provide_buffers(uint16_t bid, unsigned count);
+};
+
+#endif // URING_H